@@ -29,6 +29,7 @@ static u32 WriteFrameAddr[NUMBER_OF_FRAMES];
 static u32 ResourceAddr; // resource buffer
 static u32 mappedResAddr; // logical address
 static u32 CamFrameAddr; // dummy camera buffer
+static u32 StaticFrameAddr; // static layers of the scene
 
 // driver instances
 static VdmaInstance vdmaInst_0;
@@ -40,13 +41,21 @@ static GfxaccelInstance gfxaccelInst;
 static int fbActive;
 static int fbBackgd;
 
+// static layers of each scene, drawn into StaticFrameAddr when the
+// scene starts; a frame buffer gets them back where it was drawn over
+static GfxaccelList staticList[3];
+static int staticScene = -1;
+static DamageRegion frameDamage[2];
+static u32 frameCount = 0;
+static u64 damagePixels = 0;
+
 // flag for wav file playback
 static int wavfile_played = 0;
-static WavHeader wavheader;
-static int wav_pos = 0;
 static int def_volume = 10;
 
 static int quit = 0;
+static int headless = 0; // frames per scene drawn by the software gfxaccel (-g)
+static u32 headlessTime = 0;
 
 static Sprite Sprite1 = {
 	448, // x;
@@ -143,7 +152,7 @@ static void unmapResourceVirAddress(u32 virtAddress)
 		munmap((void *)virtAddress, frame_page);
 }
 
-static void drawTrianglePolygons(int fbNum)
+static void drawTrianglePolygons(u32 fbAddr)
 {
 	pos points[] = {
 		{ 100, 100 },
@@ -175,15 +184,15 @@ static void drawTrianglePolygons(int fbNum)
 	};
 	int i;
 
-	gfxaccel_draw_line(&gfxaccelInst, WriteFrameAddr[fbNum], 
+	gfxaccel_submit_draw_line(&gfxaccelInst, fbAddr, 
 		points[0].x, points[0].y, points[1].x, points[1].y, 
 		0xffffffff);
 	for (i = 0; i < sizeof(points)/sizeof(points[0]) - 2; i++)
 	{
-		gfxaccel_draw_line(&gfxaccelInst, WriteFrameAddr[fbNum], 
+		gfxaccel_submit_draw_line(&gfxaccelInst, fbAddr, 
 			points[i+1].x, points[i+1].y, points[i+2].x, points[i+2].y, 
 			0xffffffff);
-		gfxaccel_draw_line(&gfxaccelInst, WriteFrameAddr[fbNum], 
+		gfxaccel_submit_draw_line(&gfxaccelInst, fbAddr, 
 			points[i+2].x, points[i+2].y, points[i].x, points[i].y, 
 			0x3ff00000);
 	}
@@ -198,7 +207,7 @@ static void fillColorTiles(u32 baseAddr)
 		for (j = 0; j < 800 / 16; j++) {
 			col = ((i) << 2) | (j);
 			data = RGB1(col >> 2, col >> 1, col);
-			gfxaccel_fill_rect(&gfxaccelInst, baseAddr, 
+			gfxaccel_submit_fill_rect(&gfxaccelInst, baseAddr, 
 				j * 16, i * 16, j * 16 + 15, i * 16 + 15, 
 				data);
 		}
@@ -225,7 +234,7 @@ static void copyBitmapToFramebuffer(u32 *dst, u32 *src, int width, int height, i
 	}
 }
 
-static void loadBitmapFiletoFB(u32 baseAddr)
+static void loadBitmapFiletoFB(u32 *fb)
 {
 	Bitmap bmp;
 	printf("load reource file res/resource.png ...\n");
@@ -233,7 +242,7 @@ static void loadBitmapFiletoFB(u32 baseAddr)
 //	loadBitmapFile("./res/resource.bmp", &bmp);
 	printf("done.\n");
 	printf("copy bitmap to resource frame buffer ...\n");
-	copyBitmapToFramebuffer((u32 *)baseAddr, bmp.data, 
+	copyBitmapToFramebuffer(fb, bmp.data, 
 		800, 480, DISP_WIDTH);
 	printf("done.\n");
 	if (bmp.data) free(bmp.data);
@@ -271,20 +280,33 @@ static int parse_argument(int argc, char *argv[])
 			printf("  Set default volume to %d.\n", def_volume);
 			break;
 		}
+		else if (*argv[i] == '-' && *(argv[i]+1) == 'g')
+		{
+			headless = (i + 1 < argc)? atoi(argv[i+1]): 0;
+			if (headless <= 0) headless = 60;
+			printf("  Headless mode: %d frames per scene.\n", headless);
+			break;
+		}
 	}
 
 	return (mode);
 }
 
-static void DrawDebugInfo(int fbNum)
+// the headless mode counts frames instead, so that its output repeats
+static u32 GetSystemTime(void)
+{
+	return (headless? headlessTime: game_get_systemtime());
+}
+
+static void DrawDebugInfo(u32 fbAddr)
 {
 	u8 info[16];
-	u32 systime = game_get_systemtime();
+	u32 systime = GetSystemTime();
 	sprintf(info, "%04d:%06d", (int)(systime / 60), (int)systime);
-	drawText(WriteFrameAddr[fbNum], 606, 448, info);
+	drawText(fbAddr, 606, 448, info);
 }
 
-static void DrawMap(int fbNum)
+static void DrawMap(u32 fbAddr)
 {
 	int i;
 	int x, y;
@@ -297,60 +319,38 @@ static void DrawMap(int fbNum)
 		data = mapData[i];
 		src_x = (data & 0x07) * 32;
 		src_y = (data >> 4)   * 32;
-		gfxaccel_bitblt(&gfxaccelInst, 
+		gfxaccel_submit_bitblt(&gfxaccelInst, 
 			ResourceAddr, src_x, src_y, 32, 32, 
-			WriteFrameAddr[fbNum], x + 160, y, 
+			fbAddr, x + 160, y, 
 			GFXACCEL_BB_NONE);
 	}
 }
 
-static void DrawTestFrame(int fbNum)
+static void DrawTestFrame(u32 fbAddr)
 {
-    gfxaccel_fill_rect(&gfxaccelInst, WriteFrameAddr[fbNum],
+    gfxaccel_submit_fill_rect(&gfxaccelInst, fbAddr,
 		 0,  0, 799, 479, RGB8(16, 16, 16));
 
     // Invoke fill rectangle accelerator
-    gfxaccel_fill_rect(&gfxaccelInst, WriteFrameAddr[fbNum],
+    gfxaccel_submit_fill_rect(&gfxaccelInst, fbAddr,
 		 80,  80, 719, 399, RGB8(255, 255, 255));
     // Invoke fill rectangle accelerator
-    gfxaccel_fill_rect(&gfxaccelInst, WriteFrameAddr[fbNum],
+    gfxaccel_submit_fill_rect(&gfxaccelInst, fbAddr,
 		 83,  83, 716, 396, RGB8(0, 64, 255));
     // Invoke fill rectangle accelerator
-    gfxaccel_fill_rect(&gfxaccelInst, WriteFrameAddr[fbNum],
+    gfxaccel_submit_fill_rect(&gfxaccelInst, fbAddr,
 		 80, 240, 719, 241, RGB8(255, 255, 255));
     // Invoke fill rectangle accelerator
-    gfxaccel_fill_rect(&gfxaccelInst, WriteFrameAddr[fbNum],
+    gfxaccel_submit_fill_rect(&gfxaccelInst, fbAddr,
 		480, 240, 481, 399, RGB8(255, 255, 255));
 }
 
-static float vol_curve[] = { 0, 1, 4, 9, 16, 25, 36, 49, 64, 81, 100, 121, 144, 169, 204, 256.0 };
-
+// streamed from the file, so the WAV is not kept in memory
 void PlayTestWav(void)
 {
-	int len = 800 + 80; // 48kHz / 60Hz = 800frame. adds 10 percent frames to avoid data underflow.
-	float sdata;
-	u32 stat;
-	u32 ldata;
-	int i;
-	int volume = azplf_audio_get_volume();
-
-	if (wav_pos + len > wavheader.Nbyte/2) {
-		len = wavheader.Nbyte/2 - wav_pos;
-		// last frame is played here.
-		wavfile_played = 1;
-	}
-
-	for (i = 0; i < len; i++)
-	{
-		while ((stat = i2sout_getstatus(0x0C) & 0xC));
-
-		sdata = wavheader.data[wav_pos + i];
-		sdata = sdata * vol_curve[volume] / 256; // attenuator
-		ldata = (u32)sdata;
-		ldata = ((ldata & 0xFFFF) << 16) | (ldata & 0xFFFF);
-		i2sout_senddata(4, ldata);
-	}
-	wav_pos += len;
+	if (azplf_audio_play_stream("res/test.wav") != PST_SUCCESS)
+		printf("Error: res/test.wav cannot be played.\n");
+	wavfile_played = 1;
 }
 
 static char mml[] = "cegefdggcegefdgrcegefdggcegefdcr";
@@ -365,6 +365,7 @@ void PlayMusic(int pos)
 	int note_p;
 	int vol = azplf_audio_get_volume();
 	float data;
+	u32 cycle[1745 * 2];
 
 	if (note == 'r') return;
 
@@ -376,16 +377,16 @@ void PlayMusic(int pos)
 	len = 48000.0 / freq[note_p];
 	len /= 2;
 
-	data = 0x2000 * vol_curve[vol] / 256;
+	data = 0x2000 * mixer_vol_curve[vol] / 256;
 
 	if (len > 1745) return;
 
-	for (j = 0; j < 50; j++) {
-		for (i = 0; i < (int)len; i++)
-			i2sout_senddata(4, ((u16)data << 16) | (u16)data); // L=data; R=data
-		for (i = 0; i < (int)len; i++)
-			i2sout_senddata(4, 0x00000000); // L=0x0000; R=0x0000
-   	}
+	for (i = 0; i < (int)len; i++) {
+		cycle[i] = ((u16)data << 16) | (u16)data; // L=data; R=data
+		cycle[(int)len + i] = 0x00000000; // L=0x0000; R=0x0000
+	}
+	for (j = 0; j < 50; j++)
+		azplf_audio_write(cycle, (int)len * 2);
 }
 
 static void UpdateAudio(int scene)
@@ -398,6 +399,8 @@ static void UpdateAudio(int scene)
 	if (scene == 0) {
 		if (!wavfile_played) PlayTestWav();
 	} else if (scene == 1) {
+		// the music takes over the audio output from the stream
+		azplf_audio_stop_stream();
 		switch (mode) {
 		case 0:
 			PlayMusic(sound_pos);
@@ -412,63 +415,118 @@ static void UpdateAudio(int scene)
 	mode = (mode + 1) % 15;
 }
 
+// records the static layers of a scene once, then draws them into
+// StaticFrameAddr
+static void DrawStaticLayer(int scene)
+{
+	GfxaccelList *list = &staticList[scene];
+
+	if (!list->num) {
+		gfxaccel_list_begin(&gfxaccelInst, list);
+		switch (scene) {
+		case 0:
+			DrawTestFrame(StaticFrameAddr);
+			drawTrianglePolygons(StaticFrameAddr);
+			drawText(StaticFrameAddr, 176, 448, "\x80\x80\x80 2021 (c) ATSUPI.COM \x80\x80\x80");
+			break;
+		case 1:
+			gfxaccel_submit_bitblt(&gfxaccelInst, 
+				ResourceAddr, 0, 0, 800, 128, 
+				StaticFrameAddr, 0, 0, GFXACCEL_BB_NONE);
+			DrawMap(StaticFrameAddr);
+			gfxaccel_submit_fill_rect(&gfxaccelInst, StaticFrameAddr, 
+				  0, 128, 159, 479, 0);
+			gfxaccel_submit_fill_rect(&gfxaccelInst, StaticFrameAddr, 
+				640, 128, 799, 479, 0);
+			break;
+		case 2:
+			gfxaccel_submit_fill_rect(&gfxaccelInst, StaticFrameAddr, 0, 0, 799, 479, 0x0);
+			drawText(StaticFrameAddr, 240, 240, "APPLICATION CLOSED.");
+			break;
+		}
+		gfxaccel_list_end(&gfxaccelInst);
+	}
+	gfxaccel_list_replay(&gfxaccelInst, list);
+}
+
+// copies the static layers back over the damaged area of a frame buffer
+static void RestoreStaticLayer(DamageRegion *dmg)
+{
+	DamageRect *r;
+	int i;
+
+	damagePixels += damage_area(dmg);
+	for (i = 0; i < dmg->num; i++) {
+		r = &dmg->rects[i];
+		gfxaccel_submit_bitblt(&gfxaccelInst, 
+			StaticFrameAddr, r->x1, r->y1, r->x2 - r->x1 + 1, r->y2 - r->y1 + 1, 
+			dmg->fb, r->x1, r->y1, GFXACCEL_BB_NONE);
+	}
+	damage_clear(dmg);
+}
+
 static void UpdateFrame(int scene)
 {
 	static u32 prev_time = 0;
-	u32 systime = game_get_systemtime();
+	u32 systime = GetSystemTime();
 	static int x = 0;
 	static int y = 0;
 	int i, j;
 	int status;
+	GfxaccelFence fence;
 
 	if (prev_time == systime) return;
 	prev_time = systime;
 
-	UpdateAudio(scene);
+	// static layers, redrawn only where the last frame in this buffer drew
+	if (staticScene != scene) {
+		DrawStaticLayer(scene);
+		staticScene = scene;
+		damage_add_all(&frameDamage[0]);
+		damage_add_all(&frameDamage[1]);
+	}
+	RestoreStaticLayer(&frameDamage[fbBackgd]);
 
-	// draw backfround frame as per scene number
+	// moving parts as per scene number; the commands are queued
+	gfxaccel_track_damage(&gfxaccelInst, &frameDamage[fbBackgd]);
 	switch (scene) {
 	case 0:
-		DrawTestFrame(fbBackgd);
-		drawTrianglePolygons(fbBackgd);
-		drawText(WriteFrameAddr[fbBackgd], 176, 448, "\x80\x80\x80 2021 (c) ATSUPI.COM \x80\x80\x80");
-		DrawDebugInfo(fbBackgd);
-		systime = game_get_systemtime();
+		DrawDebugInfo(WriteFrameAddr[fbBackgd]);
+		systime = GetSystemTime();
 		drawSprite(&Sprite2, WriteFrameAddr[fbBackgd], systime);
 		break;
 
 	case 1:
-		gfxaccel_bitblt(&gfxaccelInst, 
-			ResourceAddr, 0, 0, 800, 128, 
-			WriteFrameAddr[fbBackgd], 0, 0, GFXACCEL_BB_NONE);
-		DrawMap(fbBackgd);
-		gfxaccel_fill_rect(&gfxaccelInst, WriteFrameAddr[fbBackgd], 
-			  0, 128, 159, 479, 0);
-		gfxaccel_fill_rect(&gfxaccelInst, WriteFrameAddr[fbBackgd], 
-			640, 128, 799, 479, 0);
-		DrawDebugInfo(fbBackgd);
-		gfxaccel_fill_rect(&gfxaccelInst, WriteFrameAddr[fbBackgd], 
+		DrawDebugInfo(WriteFrameAddr[fbBackgd]);
+		gfxaccel_submit_fill_rect(&gfxaccelInst, WriteFrameAddr[fbBackgd], 
 			x * 32, y * 32, x * 32 + 63, y * 32 + 63, 
 			RGB8(255, 255, 255));
 	    if (++x == 24) {
 	    	x = 0;
 	    	if (++y == 14) y = 0;
 	    }
-		systime = game_get_systemtime();
-		drawSprite(&Sprite1, WriteFrameAddr[fbBackgd], systime);
+		// drawn every frame so that it stays over the moving square
+		drawSprite(&Sprite1, WriteFrameAddr[fbBackgd], 0);
+		systime = GetSystemTime();
 		drawSprite(&Sprite2, WriteFrameAddr[fbBackgd], systime);
 		Sprite2.y += 2;
 		if (Sprite2.y > 448) Sprite2.y = 0;
 		break;
 	case 2:
-	    gfxaccel_fill_rect(&gfxaccelInst, WriteFrameAddr[fbBackgd], 0, 0, 799, 479, 0x0);
-		drawText(WriteFrameAddr[fbBackgd], 240, 240, "APPLICATION CLOSED.");
 		break;
 	}
+	gfxaccel_track_damage(&gfxaccelInst, NULL);
+
+	// the game logic runs while gfxaccel draws the frame
+	fence = gfxaccel_fence(&gfxaccelInst);
+	if (!headless) UpdateAudio(scene);
+	gfxaccel_wait_fence(&gfxaccelInst, fence);
 
 	// double buffering: switch background frame to active frame.
+	frameCount++;
 	fbActive ^= 1;
 	fbBackgd ^= 1;
+	if (headless) return;
 	status = vdma_start_parking(&vdmaInst_0, VDMA_READ, fbActive);
 	if (status != PST_SUCCESS) {
 		printf("Start Park failed\r\n");
@@ -479,6 +537,99 @@ static void UpdateFrame(int scene)
 #endif
 }
 
+static void DumpGfxStats(void)
+{
+	GfxaccelStats gfx;
+	GfxaccelListStats st;
+	int i;
+
+	gfxaccel_get_stats(&gfxaccelInst, &gfx);
+	if (frameCount) {
+		printf("[gfx] %u frames, per frame: %u cmds, %llu register writes, %llu elided\n",
+			frameCount, gfx.cmds / frameCount, gfx.reg_writes / frameCount, gfx.reg_elided / frameCount);
+		printf("[gfx] per frame: %llu pixels drawn, %llu restored (full frame %d)\n",
+			gfx.pixels / frameCount, damagePixels / frameCount, DISP_WIDTH * DISP_HEIGHT);
+	}
+
+	for (i = 0; i < 3; i++) {
+		gfxaccel_list_get_stats(&staticList[i], &st);
+		if (!st.replays) continue;
+		printf("[gfx] scene %d: %d cmds, %u replays, submit avg=%llu us, run avg=%llu us max=%u us\n",
+			i, staticList[i].num, st.replays, st.submit_ns / st.replays / 1000,
+			st.run_ns / st.replays / 1000, st.run_ns_max / 1000);
+	}
+}
+
+// writes a frame buffer as a binary PPM and returns its FNV-1a hash
+static u32 SaveFrame(u32 fbAddr, char *fn)
+{
+	u32 *fb = gfxaccel_get_fb(&gfxaccelInst, fbAddr);
+	u32 hash = 2166136261u;
+	FILE *fp;
+	int i;
+
+	for (i = 0; i < DISP_WIDTH * DISP_HEIGHT; i++) {
+		hash = (hash ^ (fb[i] & 0xff)) * 16777619u;
+		hash = (hash ^ (fb[i] >> 8 & 0xff)) * 16777619u;
+		hash = (hash ^ (fb[i] >> 16 & 0xff)) * 16777619u;
+		hash = (hash ^ (fb[i] >> 24)) * 16777619u;
+	}
+	fp = fopen(fn, "wb");
+	if (!fp) {
+		printf("Error: %s cannot be opened.\n", fn);
+		return (hash);
+	}
+	fprintf(fp, "P6\n%d %d\n255\n", DISP_WIDTH, DISP_HEIGHT);
+	for (i = 0; i < DISP_WIDTH * DISP_HEIGHT; i++) {
+		fputc(fb[i] >> 22 & 0xff, fp);
+		fputc(fb[i] >> 12 & 0xff, fp);
+		fputc(fb[i] >> 2 & 0xff, fp);
+	}
+	fclose(fp);
+	return (hash);
+}
+
+// draws every scene with the software gfxaccel in host memory, without
+// VDMA, LCD or audio, and saves the last frame of each as sceneN.ppm
+static int RunHeadless(void)
+{
+	char fn[16];
+	pos basePos;
+	int scene;
+	int i;
+
+	if (gfxaccel_init_soft(&gfxaccelInst, WRITE_ADDRESS_BASE, 5 * frame_page) != PST_SUCCESS)
+		return PST_FAILURE;
+
+	gfxaccel_submit_fill_rect(&gfxaccelInst, WriteFrameAddr[0], 0, 0, 799, 479, 0x0);
+	gfxaccel_submit_fill_rect(&gfxaccelInst, WriteFrameAddr[1], 0, 0, 799, 479, 0x0);
+	fillColorTiles(ResourceAddr);
+	loadBitmapFiletoFB(gfxaccel_get_fb(&gfxaccelInst, ResourceAddr));
+	basePos.x = 512;
+	basePos.y = 0;
+	configSpriteResouce(&gfxaccelInst, ResourceAddr, &basePos);
+	basePos.x = 256;
+	basePos.y = 0;
+	configFontResouce(&gfxaccelInst, ResourceAddr, &basePos);
+
+	gfxaccel_start_queue(&gfxaccelInst);
+	for (scene = 0; scene < 3; scene++) {
+		for (i = 0; i < headless; i++) {
+			headlessTime++;
+			UpdateFrame(scene);
+		}
+		gfxaccel_finish(&gfxaccelInst);
+		sprintf(fn, "scene%d.ppm", scene);
+		printf("%s: hash=%08x\n", fn, SaveFrame(WriteFrameAddr[fbActive], fn));
+	}
+
+	DumpGfxStats();
+	for (i = 0; i < 3; i++)
+		gfxaccel_list_free(&gfxaccelInst, &staticList[i]);
+	gfxaccel_deinit(&gfxaccelInst);
+	return PST_SUCCESS;
+}
+
 static void TestPngFileConversion(void)
 {
 	Bitmap bmp;
@@ -510,11 +661,17 @@ int main(int argc, char *argv[])
 	WriteFrameAddr[1] = WRITE_ADDRESS_BASE + frame_page;
 	ResourceAddr      = WriteFrameAddr[1]  + frame_page;
 	CamFrameAddr      = ResourceAddr + frame_page;
+	StaticFrameAddr   = CamFrameAddr + frame_page;
+	damage_init(&frameDamage[0], WriteFrameAddr[0]);
+	damage_init(&frameDamage[1], WriteFrameAddr[1]);
 
 	// decide active/background frame
 	fbActive = 0;
 	fbBackgd = 1;
 
+	if (headless)
+		return (RunHeadless());
+
 	/* The information of the XAxiVdma_Config comes from hardware build.
 	 * The user IP should pass this information to the AXI DMA core.
 	 */
@@ -572,15 +729,15 @@ int main(int argc, char *argv[])
 
     // Clear frame buffer
     printf("Clear frame buffer\r\n");
-    gfxaccel_fill_rect(&gfxaccelInst, WriteFrameAddr[0], 0, 0, 799, 479, 0x0);
-    gfxaccel_fill_rect(&gfxaccelInst, WriteFrameAddr[1], 0, 0, 799, 479, 0x0);
+    gfxaccel_submit_fill_rect(&gfxaccelInst, WriteFrameAddr[0], 0, 0, 799, 479, 0x0);
+    gfxaccel_submit_fill_rect(&gfxaccelInst, WriteFrameAddr[1], 0, 0, 799, 479, 0x0);
 
     // Setup Resource frame
     printf("Setup Resource frame buffer\r\n");
     fillColorTiles(ResourceAddr);
 
     printf("BitBlt Resource frame buffer to main frame buffer\r\n");
-	DrawTestFrame(fbActive);
+	DrawTestFrame(WriteFrameAddr[fbActive]);
 
     // Output results
 	ReadAddr = vdma_get_frame_address(&vdmaInst_0, 0);
@@ -595,11 +752,11 @@ int main(int argc, char *argv[])
     }
 	printf("\r\n");
 
-	drawTrianglePolygons(fbActive);
+	drawTrianglePolygons(WriteFrameAddr[fbActive]);
 
 	// configure sprite drawing module
 	printf("loadBitmapFiletoFB()\n");
-	loadBitmapFiletoFB(mappedResAddr);
+	loadBitmapFiletoFB((u32 *)mappedResAddr);
 
 	printf("configure Sprite Resource\n");
 	// start position on resource frame buffer
@@ -618,16 +775,15 @@ int main(int argc, char *argv[])
 	azplf_audio_initSSM2603();
 	azplf_audio_set_volume(def_volume);
 	i2sout_senddata(0, 0xFF000000); // debug=255 (invert data), mute=0, lr_mode=LR
+	azplf_audio_start_thread();
 
 	// Test conversion from bitmap to png
 //	TestPngFileConversion();
 
-	if (!azplf_audio_load_wav("res/test.wav", &wavheader)) {
-		quit = 1;
-	}
-
 	sleep(1); // 1sec wait before starting game work thread
 
+	// the game thread is the only one drawing from here
+	gfxaccel_start_queue(&gfxaccelInst);
 	status = azplf_start_game_thread(INITIAL_SCENE, UpdateFrame);
 	if (status != PST_SUCCESS) {
 		printf("Error: Game worker thread cannot start.\n");
@@ -657,7 +813,6 @@ int main(int argc, char *argv[])
 		case 1: // game main
 			if (ch == 0x1b || ch == 'e') { // ESC
 				game_set_next_scene(0);
-				wav_pos = 0;
 				wavfile_played = 0;
 			} else if (ch == '1') { // volume down
 				int vol = azplf_audio_get_volume() - 1;
@@ -683,9 +838,11 @@ int main(int argc, char *argv[])
 	// draw ending screen
     printf("--- Exiting main() --- \r\n");
 
-	azplf_audio_free_wav(&wavheader);
 	azplf_game_deinit();
 	azplf_audio_deinit();
+	DumpGfxStats();
+	for (i = 0; i < 3; i++)
+		gfxaccel_list_free(&gfxaccelInst, &staticList[i]);
 	gfxaccel_deinit(&gfxaccelInst);
 	lq070out_deinit(&lq070Inst);
 	unmapResourceVirAddress(mappedResAddr);
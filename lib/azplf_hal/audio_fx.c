@@ -0,0 +1,489 @@
+/******************************************************
+ *    Filename:     audio_fx.c
+ *     Purpose:     Q15 effects chain (filter, echo, reverb)
+ *  Target Plf:     ZYBO (azplf)
+ *  Created on: 	2026/10/17
+ * Modified on:
+ *      Author: 	atsupi.com
+ *     Version:		0.90
+ ******************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "azplf_bsp.h"
+#include "audio_fx.h"
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define FX_NEON
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define FX_SSE2
+#endif
+
+#define Q15_ONE					32767
+#define Z_SHIFT					8		// extra fraction bits of the filter states
+#define REV_INPUT				1024	// Q15 gain into the combs (1/32)
+#define REV_ALLPASS_G			16384	// 0.5
+#define REV_SPREAD				25		// right channel delays are longer
+
+// Schroeder/Freeverb tunings scaled to 48kHz
+static const int comb_len[FX_COMB_NUM] = { 1695, 1760, 1623, 1548 };
+static const int allpass_len[FX_ALLPASS_NUM] = { 605, 480 };
+
+static inline short saturate(int value)
+{
+	if (value >  32767) return ( 32767);
+	if (value < -32768) return (-32768);
+	return ((short)value);
+}
+
+// Q15 multiply, rounds toward minus infinity like vqdmulh
+static inline int qmul(int x, int g)
+{
+	return ((x * g) >> 15);
+}
+
+static short percent_q15(int percent, int max)
+{
+	if (percent < 0) percent = 0;
+	if (percent > max) percent = max;
+	return ((short)(percent * Q15_ONE / 100));
+}
+
+/******************************************************
+ * block kernels; d points into a delay line and is
+ * read before it is written at every index
+ ******************************************************/
+
+static void echo_scalar(short *io, short *d, int n, short fb, short mix)
+{
+	int i, x, y;
+
+	for (i = 0; i < n; i++) {
+		x = io[i];
+		y = d[i];
+		io[i] = saturate(x + qmul(y, mix));
+		d[i]  = saturate(x + qmul(y, fb));
+	}
+}
+
+static void comb_scalar(const short *in, short *d, short *acc, int n, short fb)
+{
+	int i, y;
+
+	for (i = 0; i < n; i++) {
+		y = d[i];
+		acc[i] = saturate(acc[i] + y);
+		d[i]   = saturate(in[i] + qmul(y, fb));
+	}
+}
+
+static void allpass_scalar(short *io, short *d, int n, short g)
+{
+	int i, x, y;
+
+	for (i = 0; i < n; i++) {
+		x = io[i];
+		y = d[i];
+		io[i] = saturate(y - x);
+		d[i]  = saturate(x + qmul(y, g));
+	}
+}
+
+static void mix_scalar(short *io, const short *wet, int n, short mix)
+{
+	int i;
+
+	for (i = 0; i < n; i++)
+		io[i] = saturate(io[i] + qmul(wet[i], mix));
+}
+
+#if defined(FX_NEON)
+
+static void echo_block(short *io, short *d, int n, short fb, short mix)
+{
+	int16x8_t g = vdupq_n_s16(fb), m = vdupq_n_s16(mix);
+	int i;
+
+	for (i = 0; i + 8 <= n; i += 8) {
+		int16x8_t x = vld1q_s16(&io[i]);
+		int16x8_t y = vld1q_s16(&d[i]);
+		vst1q_s16(&io[i], vqaddq_s16(x, vqdmulhq_s16(y, m)));
+		vst1q_s16(&d[i],  vqaddq_s16(x, vqdmulhq_s16(y, g)));
+	}
+	echo_scalar(&io[i], &d[i], n - i, fb, mix);
+}
+
+static void comb_block(const short *in, short *d, short *acc, int n, short fb)
+{
+	int16x8_t g = vdupq_n_s16(fb);
+	int i;
+
+	for (i = 0; i + 8 <= n; i += 8) {
+		int16x8_t y = vld1q_s16(&d[i]);
+		vst1q_s16(&acc[i], vqaddq_s16(vld1q_s16(&acc[i]), y));
+		vst1q_s16(&d[i],   vqaddq_s16(vld1q_s16(&in[i]), vqdmulhq_s16(y, g)));
+	}
+	comb_scalar(&in[i], &d[i], &acc[i], n - i, fb);
+}
+
+static void allpass_block(short *io, short *d, int n, short g)
+{
+	int16x8_t gv = vdupq_n_s16(g);
+	int i;
+
+	for (i = 0; i + 8 <= n; i += 8) {
+		int16x8_t x = vld1q_s16(&io[i]);
+		int16x8_t y = vld1q_s16(&d[i]);
+		vst1q_s16(&io[i], vqsubq_s16(y, x));
+		vst1q_s16(&d[i],  vqaddq_s16(x, vqdmulhq_s16(y, gv)));
+	}
+	allpass_scalar(&io[i], &d[i], n - i, g);
+}
+
+static void mix_block(short *io, const short *wet, int n, short mix)
+{
+	int16x8_t m = vdupq_n_s16(mix);
+	int i;
+
+	for (i = 0; i + 8 <= n; i += 8)
+		vst1q_s16(&io[i], vqaddq_s16(vld1q_s16(&io[i]), vqdmulhq_s16(vld1q_s16(&wet[i]), m)));
+	mix_scalar(&io[i], &wet[i], n - i, mix);
+}
+
+#elif defined(FX_SSE2)
+
+// (x * g) >> 15 from the high and low halves of the products
+static inline __m128i qmul_sse2(__m128i x, __m128i g)
+{
+	return (_mm_or_si128(_mm_slli_epi16(_mm_mulhi_epi16(x, g), 1),
+						 _mm_srli_epi16(_mm_mullo_epi16(x, g), 15)));
+}
+
+static void echo_block(short *io, short *d, int n, short fb, short mix)
+{
+	__m128i g = _mm_set1_epi16(fb), m = _mm_set1_epi16(mix);
+	int i;
+
+	for (i = 0; i + 8 <= n; i += 8) {
+		__m128i x = _mm_loadu_si128((const __m128i *)&io[i]);
+		__m128i y = _mm_loadu_si128((const __m128i *)&d[i]);
+		_mm_storeu_si128((__m128i *)&io[i], _mm_adds_epi16(x, qmul_sse2(y, m)));
+		_mm_storeu_si128((__m128i *)&d[i],  _mm_adds_epi16(x, qmul_sse2(y, g)));
+	}
+	echo_scalar(&io[i], &d[i], n - i, fb, mix);
+}
+
+static void comb_block(const short *in, short *d, short *acc, int n, short fb)
+{
+	__m128i g = _mm_set1_epi16(fb);
+	int i;
+
+	for (i = 0; i + 8 <= n; i += 8) {
+		__m128i y = _mm_loadu_si128((const __m128i *)&d[i]);
+		__m128i a = _mm_loadu_si128((const __m128i *)&acc[i]);
+		__m128i x = _mm_loadu_si128((const __m128i *)&in[i]);
+		_mm_storeu_si128((__m128i *)&acc[i], _mm_adds_epi16(a, y));
+		_mm_storeu_si128((__m128i *)&d[i],   _mm_adds_epi16(x, qmul_sse2(y, g)));
+	}
+	comb_scalar(&in[i], &d[i], &acc[i], n - i, fb);
+}
+
+static void allpass_block(short *io, short *d, int n, short g)
+{
+	__m128i gv = _mm_set1_epi16(g);
+	int i;
+
+	for (i = 0; i + 8 <= n; i += 8) {
+		__m128i x = _mm_loadu_si128((const __m128i *)&io[i]);
+		__m128i y = _mm_loadu_si128((const __m128i *)&d[i]);
+		_mm_storeu_si128((__m128i *)&io[i], _mm_subs_epi16(y, x));
+		_mm_storeu_si128((__m128i *)&d[i],  _mm_adds_epi16(x, qmul_sse2(y, gv)));
+	}
+	allpass_scalar(&io[i], &d[i], n - i, g);
+}
+
+static void mix_block(short *io, const short *wet, int n, short mix)
+{
+	__m128i m = _mm_set1_epi16(mix);
+	int i;
+
+	for (i = 0; i + 8 <= n; i += 8) {
+		__m128i x = _mm_loadu_si128((const __m128i *)&io[i]);
+		__m128i w = _mm_loadu_si128((const __m128i *)&wet[i]);
+		_mm_storeu_si128((__m128i *)&io[i], _mm_adds_epi16(x, qmul_sse2(w, m)));
+	}
+	mix_scalar(&io[i], &wet[i], n - i, mix);
+}
+
+#else
+
+#define echo_block		echo_scalar
+#define comb_block		comb_scalar
+#define allpass_block	allpass_scalar
+#define mix_block		mix_scalar
+
+#endif
+
+/******************************************************
+ * stages
+ ******************************************************/
+
+// frames of the delay line for the next n frames of the block,
+// up to its wrap point
+static inline int delay_span(const FxDelay *d, int n)
+{
+	return ((d->len - d->pos < n)? d->len - d->pos: n);
+}
+
+static inline void delay_advance(FxDelay *d, int n)
+{
+	d->pos += n;
+	if (d->pos >= d->len) d->pos = 0;
+}
+
+static int delay_alloc(FxDelay *d, int len)
+{
+	short *buf;
+
+	if (len < 1) len = 1;
+	if (d->buf && d->len == len) return PST_SUCCESS;
+
+	buf = (short *)calloc(len, sizeof(short));
+	if (!buf) {
+		printf("Error: Cannot allocate effect delay line.\n");
+		return PST_FAILURE;
+	}
+	free(d->buf);
+	d->buf = buf;
+	d->len = len;
+	d->pos = 0;
+	return PST_SUCCESS;
+}
+
+static void delay_free(FxDelay *d)
+{
+	free(d->buf);
+	d->buf = NULL;
+	d->len = 0;
+	d->pos = 0;
+}
+
+// one-pole filter per sample; only the state recursion stays scalar
+static void lowpass(short *io, int *z, int n, short a, int high)
+{
+	int i, x, lp;
+
+	for (i = 0; i < n; i++) {
+		x = io[i];
+		*z += (int)(((long long)a * (x * (1 << Z_SHIFT) - *z)) >> 15);
+		lp = *z >> Z_SHIFT;
+		io[i] = (high)? saturate(x - lp): (short)lp;
+	}
+}
+
+static void run_echo(FxDelay *d, short *io, int n, short fb, short mix)
+{
+	int i, seg;
+
+	for (i = 0; i < n; i += seg) {
+		seg = delay_span(d, n - i);
+		echo_block(&io[i], &d->buf[d->pos], seg, fb, mix);
+		delay_advance(d, seg);
+	}
+}
+
+static void run_reverb(FxChain *fx, int c, const short *in, short *io, int n)
+{
+	short acc[FX_BLOCK];
+	FxDelay *d;
+	int i, k, seg;
+
+	memset(acc, 0, n * sizeof(short));
+	for (k = 0; k < FX_COMB_NUM; k++) {
+		d = &fx->comb[c][k];
+		for (i = 0; i < n; i += seg) {
+			seg = delay_span(d, n - i);
+			comb_block(&in[i], &d->buf[d->pos], &acc[i], seg, fx->rev_fb);
+			delay_advance(d, seg);
+		}
+	}
+	for (k = 0; k < FX_ALLPASS_NUM; k++) {
+		d = &fx->allpass[c][k];
+		for (i = 0; i < n; i += seg) {
+			seg = delay_span(d, n - i);
+			allpass_block(&acc[i], &d->buf[d->pos], seg, REV_ALLPASS_G);
+			delay_advance(d, seg);
+		}
+	}
+	mix_block(io, acc, n, fx->rev_mix);
+}
+
+/******************************************************
+ * configuration
+ ******************************************************/
+
+void fx_init(FxChain *fx)
+{
+	memset(fx, 0, sizeof(FxChain));
+}
+
+void fx_free(FxChain *fx)
+{
+	int c, k;
+
+	for (c = 0; c < 2; c++) {
+		delay_free(&fx->echo[c]);
+		for (k = 0; k < FX_COMB_NUM; k++) delay_free(&fx->comb[c][k]);
+		for (k = 0; k < FX_ALLPASS_NUM; k++) delay_free(&fx->allpass[c][k]);
+	}
+	fx_init(fx);
+}
+
+static void delay_clear(FxDelay *d)
+{
+	if (d->buf) memset(d->buf, 0, d->len * sizeof(short));
+	d->pos = 0;
+}
+
+void fx_reset(FxChain *fx)
+{
+	int c, k;
+
+	for (c = 0; c < 2; c++) {
+		fx->hpf_z[c] = fx->lpf_z[c] = 0;
+		delay_clear(&fx->echo[c]);
+		for (k = 0; k < FX_COMB_NUM; k++) delay_clear(&fx->comb[c][k]);
+		for (k = 0; k < FX_ALLPASS_NUM; k++) delay_clear(&fx->allpass[c][k]);
+	}
+}
+
+// Q15 coefficient of a one-pole filter at cutoff Hz
+static short pole_coef(int cutoff)
+{
+	double a = 1.0 - exp(-2.0 * M_PI * cutoff / FX_RATE);
+	int q = (int)(a * 32768 + 0.5);
+
+	if (q < 1) q = 1;
+	if (q > Q15_ONE) q = Q15_ONE;
+	return ((short)q);
+}
+
+void fx_set_hpf(FxChain *fx, int cutoff)
+{
+	if (cutoff <= 0) {
+		fx->flags &= ~FX_HPF;
+		return;
+	}
+	fx->hpf_a = pole_coef(cutoff);
+	fx->flags |= FX_HPF;
+}
+
+void fx_set_lpf(FxChain *fx, int cutoff)
+{
+	if (cutoff <= 0) {
+		fx->flags &= ~FX_LPF;
+		return;
+	}
+	fx->lpf_a = pole_coef(cutoff);
+	fx->flags |= FX_LPF;
+}
+
+int fx_set_echo(FxChain *fx, int delay_ms, int feedback, int mix)
+{
+	int len = delay_ms * (FX_RATE / 1000);
+
+	fx->flags &= ~FX_ECHO;
+	if (delay_ms <= 0) {
+		delay_free(&fx->echo[0]);
+		delay_free(&fx->echo[1]);
+		return PST_SUCCESS;
+	}
+	if (len > FX_DELAY_MAX) len = FX_DELAY_MAX;
+	if (delay_alloc(&fx->echo[0], len) != PST_SUCCESS ||
+		delay_alloc(&fx->echo[1], len) != PST_SUCCESS)
+		return PST_FAILURE;
+
+	fx->echo_fb  = percent_q15(feedback, 95);	// keeps the loop stable
+	fx->echo_mix = percent_q15(mix, 100);
+	fx->flags |= FX_ECHO;
+	return PST_SUCCESS;
+}
+
+int fx_set_reverb(FxChain *fx, int room, int mix)
+{
+	int c, k;
+
+	fx->flags &= ~FX_REVERB;
+	if (mix <= 0) {
+		for (c = 0; c < 2; c++) {
+			for (k = 0; k < FX_COMB_NUM; k++) delay_free(&fx->comb[c][k]);
+			for (k = 0; k < FX_ALLPASS_NUM; k++) delay_free(&fx->allpass[c][k]);
+		}
+		return PST_SUCCESS;
+	}
+	for (c = 0; c < 2; c++) {
+		for (k = 0; k < FX_COMB_NUM; k++) {
+			if (delay_alloc(&fx->comb[c][k], comb_len[k] + c * REV_SPREAD) != PST_SUCCESS)
+				return PST_FAILURE;
+		}
+		for (k = 0; k < FX_ALLPASS_NUM; k++) {
+			if (delay_alloc(&fx->allpass[c][k], allpass_len[k] + c * REV_SPREAD) != PST_SUCCESS)
+				return PST_FAILURE;
+		}
+	}
+
+	// comb feedback 0.7~0.9 over the room size
+	if (room < 0) room = 0;
+	if (room > 100) room = 100;
+	fx->rev_fb  = (short)((70 + room / 5) * Q15_ONE / 100);
+	fx->rev_mix = percent_q15(mix, 100);
+	fx->flags |= FX_REVERB;
+	return PST_SUCCESS;
+}
+
+/******************************************************
+ * processing
+ ******************************************************/
+
+void fx_process(FxChain *fx, u32 *frames, int n)
+{
+	short l[FX_BLOCK], r[FX_BLOCK], in[FX_BLOCK];
+	int i, j, num;
+
+	if (!fx->flags || fx->bypass) return;
+
+	for (i = 0; i < n; i += num) {
+		num = (n - i < FX_BLOCK)? n - i: FX_BLOCK;
+		for (j = 0; j < num; j++) {
+			l[j] = (short)(frames[i + j] >> 16);
+			r[j] = (short)frames[i + j];
+		}
+
+		if (fx->flags & FX_HPF) {
+			lowpass(l, &fx->hpf_z[0], num, fx->hpf_a, 1);
+			lowpass(r, &fx->hpf_z[1], num, fx->hpf_a, 1);
+		}
+		if (fx->flags & FX_LPF) {
+			lowpass(l, &fx->lpf_z[0], num, fx->lpf_a, 0);
+			lowpass(r, &fx->lpf_z[1], num, fx->lpf_a, 0);
+		}
+		if (fx->flags & FX_ECHO) {
+			run_echo(&fx->echo[0], l, num, fx->echo_fb, fx->echo_mix);
+			run_echo(&fx->echo[1], r, num, fx->echo_fb, fx->echo_mix);
+		}
+		if (fx->flags & FX_REVERB) {
+			// both channels are fed from the mono sum
+			for (j = 0; j < num; j++)
+				in[j] = (short)qmul((l[j] + r[j]) >> 1, REV_INPUT);
+			run_reverb(fx, 0, in, l, num);
+			run_reverb(fx, 1, in, r, num);
+		}
+
+		for (j = 0; j < num; j++)
+			frames[i + j] = ((u32)(u16)l[j] << 16) | (u16)r[j];
+	}
+}
@@ -0,0 +1,276 @@
+/******************************************************
+ *    Filename:     audio_mixer.c
+ *     Purpose:     multi-channel PCM mixer
+ *  Target Plf:     ZYBO (azplf)
+ *  Created on: 	2026/10/17
+ * Modified on:
+ *      Author: 	atsupi.com
+ *     Version:		0.90
+ ******************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include "azplf_bsp.h"
+#include "audio_mixer.h"
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define MIXER_NEON
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define MIXER_SSE2
+#endif
+
+// products are summed unshifted: a Q10 coefficient leaves 32bit room for
+// MIXER_MAX_CH full scale channels at unity gain (see audio_mixer.h)
+const int mixer_vol_curve[MIXER_VOL_NUM] = {
+	 0,  1,   4,   9,  16,  25,  36,  49,  64, 81, 100, 121, 144, 169, 204, 256
+};
+
+#define COEF_SHIFT				10		// channel coefficient is Q10
+
+// Q10 left/right coefficients from gain (Q8) and pan
+static void calc_coef(const MixerChannel *ch, int *cl, int *cr)
+{
+	int gain = ch->gain;
+	int pan  = ch->pan;
+
+	if (gain < 0) gain = 0;
+	if (gain > MIXER_GAIN_MAX) gain = MIXER_GAIN_MAX;
+	if (pan < MIXER_PAN_LEFT)  pan = MIXER_PAN_LEFT;
+	if (pan > MIXER_PAN_RIGHT) pan = MIXER_PAN_RIGHT;
+
+	// balance law: the centre keeps full level on both sides
+	*cl = gain * ((pan > 0)? MIXER_PAN_RIGHT - pan: MIXER_PAN_RIGHT) >> 6;
+	*cr = gain * ((pan < 0)? MIXER_PAN_RIGHT + pan: MIXER_PAN_RIGHT) >> 6;
+}
+
+static inline short saturate(int value)
+{
+	if (value >  32767) return ( 32767);
+	if (value < -32768) return (-32768);
+	return ((short)value);
+}
+
+static void mix_scalar(const short **pcm, const int *cl, const int *cr, int num, u32 *out, int n)
+{
+	int i, j;
+	int l, r;
+
+	for (i = 0; i < n; i++) {
+		l = r = 0;
+		for (j = 0; j < num; j++) {
+			l += pcm[j][i] * cl[j];
+			r += pcm[j][i] * cr[j];
+		}
+		out[i] = ((u32)(u16)saturate(l >> COEF_SHIFT) << 16) |
+				(u16)saturate(r >> COEF_SHIFT);
+	}
+}
+
+#if defined(MIXER_NEON)
+
+// 8 frames per step, accumulators stay in registers across the channels
+static void mix_block(const short **pcm, const int *cl, const int *cr, int num, u32 *out, int n)
+{
+	int i, j;
+	int16x8x2_t rl;
+
+	for (i = 0; i + 8 <= n; i += 8) {
+		int32x4_t l0 = vdupq_n_s32(0), l1 = vdupq_n_s32(0);
+		int32x4_t r0 = vdupq_n_s32(0), r1 = vdupq_n_s32(0);
+
+		for (j = 0; j < num; j++) {
+			int16x8_t s = vld1q_s16(&pcm[j][i]);
+			int16x4_t c = vdup_n_s16((short)cl[j]);
+			l0 = vmlal_s16(l0, vget_low_s16(s),  c);
+			l1 = vmlal_s16(l1, vget_high_s16(s), c);
+			c = vdup_n_s16((short)cr[j]);
+			r0 = vmlal_s16(r0, vget_low_s16(s),  c);
+			r1 = vmlal_s16(r1, vget_high_s16(s), c);
+		}
+		// vqshrn saturates; {R, L} pairs are little endian (L << 16 | R) words
+		rl.val[0] = vcombine_s16(vqshrn_n_s32(r0, COEF_SHIFT), vqshrn_n_s32(r1, COEF_SHIFT));
+		rl.val[1] = vcombine_s16(vqshrn_n_s32(l0, COEF_SHIFT), vqshrn_n_s32(l1, COEF_SHIFT));
+		vst2q_s16((int16_t *)&out[i], rl);
+	}
+	if (i < n) {
+		const short *tail[MIXER_MAX_CH];
+		for (j = 0; j < num; j++) tail[j] = &pcm[j][i];
+		mix_scalar(tail, cl, cr, num, &out[i], n - i);
+	}
+}
+
+// every channel centred: both sides are the same sum
+static void mix_mono(const short **pcm, const int *c, int num, u32 *out, int n)
+{
+	int i, j;
+	int16x8x2_t rl;
+
+	for (i = 0; i + 8 <= n; i += 8) {
+		int32x4_t m0 = vdupq_n_s32(0), m1 = vdupq_n_s32(0);
+
+		for (j = 0; j < num; j++) {
+			int16x8_t s = vld1q_s16(&pcm[j][i]);
+			int16x4_t k = vdup_n_s16((short)c[j]);
+			m0 = vmlal_s16(m0, vget_low_s16(s),  k);
+			m1 = vmlal_s16(m1, vget_high_s16(s), k);
+		}
+		rl.val[0] = vcombine_s16(vqshrn_n_s32(m0, COEF_SHIFT), vqshrn_n_s32(m1, COEF_SHIFT));
+		rl.val[1] = rl.val[0];
+		vst2q_s16((int16_t *)&out[i], rl);
+	}
+	if (i < n) {
+		const short *tail[MIXER_MAX_CH];
+		for (j = 0; j < num; j++) tail[j] = &pcm[j][i];
+		mix_scalar(tail, c, c, num, &out[i], n - i);
+	}
+}
+
+#elif defined(MIXER_SSE2)
+
+static inline __m128i madd_add(__m128i acc, __m128i s, __m128i c)
+{
+	return (_mm_add_epi32(acc, _mm_madd_epi16(s, c)));
+}
+
+// stores 8 frames from the 32bit sums; packs saturates and {R, L}
+// pairs are little endian (L << 16 | R) words
+static inline void store_frames(u32 *out, __m128i l0, __m128i l1, __m128i r0, __m128i r1)
+{
+	__m128i l = _mm_packs_epi32(_mm_srai_epi32(l0, COEF_SHIFT), _mm_srai_epi32(l1, COEF_SHIFT));
+	__m128i r = _mm_packs_epi32(_mm_srai_epi32(r0, COEF_SHIFT), _mm_srai_epi32(r1, COEF_SHIFT));
+
+	_mm_storeu_si128((__m128i *)&out[0], _mm_unpacklo_epi16(r, l));
+	_mm_storeu_si128((__m128i *)&out[4], _mm_unpackhi_epi16(r, l));
+}
+
+// 16 frames per step, accumulators stay in registers across the channels.
+// two channels are interleaved so that one _mm_madd_epi16 with
+// (c[j], c[j+1]) pairs sums both of them; num is even
+static void mix_block(const short **pcm, const int *cl, const int *cr, int num, u32 *out, int n)
+{
+	__m128i pl[MIXER_MAX_CH / 2], pr[MIXER_MAX_CH / 2];
+	int i, j, k, pairs = num / 2;
+
+	for (k = 0; k < pairs; k++) {
+		pl[k] = _mm_set1_epi32((int)((u32)cl[2 * k + 1] << 16 | (u16)cl[2 * k]));
+		pr[k] = _mm_set1_epi32((int)((u32)cr[2 * k + 1] << 16 | (u16)cr[2 * k]));
+	}
+
+	for (i = 0; i + 16 <= n; i += 16) {
+		__m128i l0 = _mm_setzero_si128(), l1 = l0, l2 = l0, l3 = l0;
+		__m128i r0 = l0, r1 = l0, r2 = l0, r3 = l0;
+
+		for (k = 0; k < pairs; k++) {
+			const short *a = &pcm[2 * k][i];
+			const short *b = &pcm[2 * k + 1][i];
+			__m128i a0 = _mm_loadu_si128((const __m128i *)a);
+			__m128i b0 = _mm_loadu_si128((const __m128i *)b);
+			__m128i a1 = _mm_loadu_si128((const __m128i *)(a + 8));
+			__m128i b1 = _mm_loadu_si128((const __m128i *)(b + 8));
+			__m128i s;
+
+			s  = _mm_unpacklo_epi16(a0, b0);		// frames 0~3
+			l0 = madd_add(l0, s, pl[k]);
+			r0 = madd_add(r0, s, pr[k]);
+			s  = _mm_unpackhi_epi16(a0, b0);		// frames 4~7
+			l1 = madd_add(l1, s, pl[k]);
+			r1 = madd_add(r1, s, pr[k]);
+			s  = _mm_unpacklo_epi16(a1, b1);		// frames 8~11
+			l2 = madd_add(l2, s, pl[k]);
+			r2 = madd_add(r2, s, pr[k]);
+			s  = _mm_unpackhi_epi16(a1, b1);		// frames 12~15
+			l3 = madd_add(l3, s, pl[k]);
+			r3 = madd_add(r3, s, pr[k]);
+		}
+		store_frames(&out[i], l0, l1, r0, r1);
+		store_frames(&out[i + 8], l2, l3, r2, r3);
+	}
+	if (i < n) {
+		const short *tail[MIXER_MAX_CH];
+		for (j = 0; j < num; j++) tail[j] = &pcm[j][i];
+		mix_scalar(tail, cl, cr, num, &out[i], n - i);
+	}
+}
+
+// every channel centred: both sides are the same sum, so half the
+// multiplies of mix_block
+static void mix_mono(const short **pcm, const int *c, int num, u32 *out, int n)
+{
+	__m128i pc[MIXER_MAX_CH / 2];
+	__m128i m;
+	int i, j, k, pairs = num / 2;
+
+	for (k = 0; k < pairs; k++)
+		pc[k] = _mm_set1_epi32((int)((u32)c[2 * k + 1] << 16 | (u16)c[2 * k]));
+
+	for (i = 0; i + 16 <= n; i += 16) {
+		__m128i m0 = _mm_setzero_si128(), m1 = m0, m2 = m0, m3 = m0;
+
+		for (k = 0; k < pairs; k++) {
+			const short *a = &pcm[2 * k][i];
+			const short *b = &pcm[2 * k + 1][i];
+			__m128i a0 = _mm_loadu_si128((const __m128i *)a);
+			__m128i b0 = _mm_loadu_si128((const __m128i *)b);
+			__m128i a1 = _mm_loadu_si128((const __m128i *)(a + 8));
+			__m128i b1 = _mm_loadu_si128((const __m128i *)(b + 8));
+
+			m0 = madd_add(m0, _mm_unpacklo_epi16(a0, b0), pc[k]);
+			m1 = madd_add(m1, _mm_unpackhi_epi16(a0, b0), pc[k]);
+			m2 = madd_add(m2, _mm_unpacklo_epi16(a1, b1), pc[k]);
+			m3 = madd_add(m3, _mm_unpackhi_epi16(a1, b1), pc[k]);
+		}
+		m = _mm_packs_epi32(_mm_srai_epi32(m0, COEF_SHIFT), _mm_srai_epi32(m1, COEF_SHIFT));
+		_mm_storeu_si128((__m128i *)&out[i],      _mm_unpacklo_epi16(m, m));
+		_mm_storeu_si128((__m128i *)&out[i + 4],  _mm_unpackhi_epi16(m, m));
+		m = _mm_packs_epi32(_mm_srai_epi32(m2, COEF_SHIFT), _mm_srai_epi32(m3, COEF_SHIFT));
+		_mm_storeu_si128((__m128i *)&out[i + 8],  _mm_unpacklo_epi16(m, m));
+		_mm_storeu_si128((__m128i *)&out[i + 12], _mm_unpackhi_epi16(m, m));
+	}
+	if (i < n) {
+		const short *tail[MIXER_MAX_CH];
+		for (j = 0; j < num; j++) tail[j] = &pcm[j][i];
+		mix_scalar(tail, c, c, num, &out[i], n - i);
+	}
+}
+
+#else
+
+#define mix_block		mix_scalar
+#define mix_mono(pcm, c, num, out, n)	mix_scalar(pcm, c, c, num, out, n)
+
+#endif
+
+void mixer_mix(const MixerChannel *ch, int num, u32 *out, int frames)
+{
+	const short *pcm[MIXER_MAX_CH];
+	int cl[MIXER_MAX_CH];
+	int cr[MIXER_MAX_CH];
+	int i, n = 0, mono = 1;
+
+	// silent channels cost nothing in the kernel
+	for (i = 0; i < num && n < MIXER_MAX_CH; i++) {
+		calc_coef(&ch[i], &cl[n], &cr[n]);
+		if (!ch[i].pcm || (!cl[n] && !cr[n])) continue;
+		if (cl[n] != cr[n]) mono = 0;
+		pcm[n++] = ch[i].pcm;
+	}
+
+	if (!n) {
+		memset(out, 0, frames * sizeof(u32));
+		return;
+	}
+#if defined(MIXER_SSE2)
+	// channels go in pairs: a silent partner for the odd one
+	if (n & 1) {
+		pcm[n] = pcm[0];
+		cl[n] = cr[n] = 0;
+		n++;
+	}
+#endif
+	if (mono)
+		mix_mono(pcm, cl, n, out, frames);
+	else
+		mix_block(pcm, cl, cr, n, out, frames);
+}
@@ -0,0 +1,344 @@
+/******************************************************
+ *    Filename:     audio_sfx.c
+ *     Purpose:     sample-accurate sound effect scheduling
+ *  Target Plf:     ZYBO (azplf)
+ *  Created on: 	2026/10/17
+ * Modified on:
+ *      Author: 	atsupi.com
+ *     Version:		0.90
+ ******************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "azplf_bsp.h"
+#include "azplf_audio.h"
+#include "ima_adpcm.h"
+#include "audio_sfx.h"
+
+static SfxClip clips[SFX_CLIP_NUM];
+
+// commands from the game thread. single producer / single consumer:
+// head is only written by sfx_play, tail only by the audio thread.
+static SfxCmd queue[SFX_QUEUE_SIZE];
+static u32 queue_head = 0;
+static u32 queue_tail = 0;
+
+// owned by the audio thread
+static SfxVoice voices[SFX_VOICE_NUM];
+static short voice_block[SFX_VOICE_NUM][SFX_ADPCM_FRAMES];
+static SfxStats stats;
+
+#define STAT_ADD(field, value)	__atomic_fetch_add(&stats.field, (value), __ATOMIC_RELAXED)
+
+// mono IMA-ADPCM at the codec rate stays compressed in the mapped
+// file; the audio thread decodes a block at a time
+static int sfx_map_adpcm(SfxClip *clip)
+{
+	WavView *view = &clip->view;
+	int bytes = view->block_align;
+	int frames = IMA_BLOCK_FRAMES(bytes, 1);
+	u32 rest;
+
+	if (bytes < 4 || frames > SFX_ADPCM_FRAMES)
+		return 0;
+	clip->adpcm        = view->data;
+	clip->adpcm_bytes  = view->bytes;
+	clip->block_bytes  = bytes;
+	clip->block_frames = frames;
+	clip->len = view->bytes / bytes * frames;
+	rest = view->bytes % bytes;
+	if (rest >= 4)
+		clip->len += IMA_BLOCK_FRAMES(rest, 1);
+	return (clip->len > 0);
+}
+
+// 16bit mono PCM at the codec rate is played from the mapped file
+static int sfx_map(SfxClip *clip, char *fn)
+{
+	WavView *view = &clip->view;
+
+	if (wav_mapfile(view, fn) != PST_SUCCESS)
+		return 0;
+	if (view->channels == 1 && view->rate == AUDIO_SAMPLE_RATE) {
+		if (view->format == WAV_FORMAT_IMA_ADPCM && sfx_map_adpcm(clip))
+			return 1;
+		if (view->pcm && view->frames) {
+			clip->pcm = view->pcm;
+			clip->len = view->frames;
+			return 1;
+		}
+	}
+	wav_unmapfile(view);
+	memset(clip, 0, sizeof(*clip));
+	return 0;
+}
+
+// loads a WAV file (PCM or IMA-ADPCM, any rate) as a mono clip at the
+// codec rate. mono files at that rate are used in place, IMA-ADPCM
+// still compressed; others are converted. returns the clip id, -1 on failure
+int sfx_load(char *fn)
+{
+	WavStream file;
+	Resampler rs;
+	short *pcm = 0, *mono = 0, *l, *r, *data;
+	int id, i, n, num, cap, len = 0;
+	int nch, resample;
+
+	for (id = 0; id < SFX_CLIP_NUM && clips[id].len; id++);
+	if (id == SFX_CLIP_NUM) {
+		printf("Error: No room for sound effect %s.\n", fn);
+		return -1;
+	}
+	if (sfx_map(&clips[id], fn))
+		return (id);
+
+	// anything else is converted on the heap
+	if (wav_openstream(&file, fn) != PST_SUCCESS)
+		return -1;
+
+	nch = file.header.Nch;
+	resample = (file.header.fs != AUDIO_SAMPLE_RATE);
+	if (resample)
+		resampler_init(&rs, file.header.fs, AUDIO_SAMPLE_RATE, AUDIO_RESAMPLE_MODE);
+
+	cap = (int)((u64)file.remain * AUDIO_SAMPLE_RATE / file.header.fs) + SFX_LOAD_BLOCK;
+	data = (short *)malloc(cap * sizeof(short));
+	pcm = (short *)malloc(SFX_LOAD_BLOCK * nch * sizeof(short));
+	mono = (short *)malloc(SFX_LOAD_BLOCK * 3 * sizeof(short));
+	if (!data || !pcm || !mono) {
+		printf("Error: Cannot allocate sound effect %s.\n", fn);
+		free(data);
+		free(pcm);
+		free(mono);
+		wav_closestream(&file);
+		return -1;
+	}
+	l = mono + SFX_LOAD_BLOCK;
+	r = l + SFX_LOAD_BLOCK;
+
+	while ((n = wav_readstream(&file, pcm, SFX_LOAD_BLOCK)) > 0) {
+		if (nch == 1) {
+			memcpy(mono, pcm, n * sizeof(short));
+		} else {
+			// first two channels, averaged
+			pcm_deinterleave(pcm, nch, l, r, n);
+			for (i = 0; i < n; i++)
+				mono[i] = (short)((l[i] + r[i]) >> 1);
+		}
+		if (resample) {
+			num = resampler_process(&rs, mono, n, &data[len], cap - len);
+		} else {
+			num = (n < cap - len)? n: cap - len;
+			memcpy(&data[len], mono, num * sizeof(short));
+		}
+		len += num;
+	}
+	free(pcm);
+	free(mono);
+	wav_closestream(&file);
+
+	if (!len) {
+		printf("Error: Sound effect %s has no samples.\n", fn);
+		free(data);
+		return -1;
+	}
+	clips[id].heap = (short *)realloc(data, len * sizeof(short));
+	if (!clips[id].heap) clips[id].heap = data;
+	clips[id].pcm = clips[id].heap;
+	clips[id].len = len;
+	return (id);
+}
+
+// the audio thread may still read the clips until it is stopped
+void sfx_unload_all(void)
+{
+	int id;
+
+	for (id = 0; id < SFX_CLIP_NUM; id++) {
+		free(clips[id].heap);
+		wav_unmapfile(&clips[id].view);
+		memset(&clips[id], 0, sizeof(clips[id]));
+	}
+	memset(voices, 0, sizeof(voices));
+	queue_tail = queue_head;
+}
+
+static int sfx_push(const SfxCmd *cmd)
+{
+	u32 head = queue_head;
+
+	if (head - __atomic_load_n(&queue_tail, __ATOMIC_ACQUIRE) >= SFX_QUEUE_SIZE) {
+		STAT_ADD(dropped, 1);
+		return PST_FAILURE;
+	}
+	queue[head & (SFX_QUEUE_SIZE - 1)] = *cmd;
+	__atomic_store_n(&queue_head, head + 1, __ATOMIC_RELEASE);
+	return PST_SUCCESS;
+}
+
+// queues clip id to start at at_sample on the sample clock
+// (azplf_audio_get_clock), or SFX_NOW. gain is Q8 (MIXER_GAIN_UNITY)
+// under the output volume, pan MIXER_PAN_LEFT~MIXER_PAN_RIGHT.
+// takes no lock; one thread (the game thread) may call it.
+// a start less than AUDIO_SFX_LEAD frames ahead of the clock may be late.
+int sfx_play(int id, u64 at_sample, int gain, int pan)
+{
+	SfxCmd cmd;
+
+	if (id < 0 || id >= SFX_CLIP_NUM || !clips[id].len)
+		return PST_FAILURE;
+	if (gain < 0) gain = 0;
+	if (gain > MIXER_GAIN_MAX) gain = MIXER_GAIN_MAX;
+
+	cmd.at = at_sample;
+	cmd.id = (short)id;
+	cmd.gain = (short)(gain * (azplf_audio_get_volume() + 1) / 16); // attenuator
+	cmd.pan = (short)pan;
+	return (sfx_push(&cmd));
+}
+
+void sfx_stop_all(void)
+{
+	SfxCmd cmd;
+
+	memset(&cmd, 0, sizeof(cmd));
+	cmd.id = -1;
+	sfx_push(&cmd);
+}
+
+void sfx_get_stats(SfxStats *result)
+{
+	*result = stats;
+}
+
+// moves queued commands into voices
+static void sfx_take(void)
+{
+	u32 head = __atomic_load_n(&queue_head, __ATOMIC_ACQUIRE);
+	u32 tail = queue_tail;
+	SfxCmd *cmd;
+	int i;
+
+	for (; tail != head; tail++) {
+		cmd = &queue[tail & (SFX_QUEUE_SIZE - 1)];
+		if (cmd->id < 0) {
+			memset(voices, 0, sizeof(voices));
+			continue;
+		}
+		for (i = 0; i < SFX_VOICE_NUM && voices[i].clip; i++);
+		if (i == SFX_VOICE_NUM) {
+			STAT_ADD(dropped, 1);
+			continue;
+		}
+		voices[i].clip = &clips[cmd->id];
+		voices[i].pos = 0;
+		voices[i].block = -1;
+		voices[i].at = cmd->at;
+		voices[i].gain = cmd->gain;
+		voices[i].pan = cmd->pan;
+	}
+	__atomic_store_n(&queue_tail, tail, __ATOMIC_RELEASE);
+}
+
+// a voice plays before the sample clock reaches until
+int sfx_pending(u64 until)
+{
+	int i;
+
+	sfx_take();
+	for (i = 0; i < SFX_VOICE_NUM; i++) {
+		if (voices[i].clip && (voices[i].pos || voices[i].at < until))
+			return 1;
+	}
+	return 0;
+}
+
+// contiguous samples of voice i from its position on; a compressed
+// clip gives the rest of the block, decoded when the voice enters it
+static const short *voice_samples(int i, int *num)
+{
+	SfxVoice *v = &voices[i];
+	const SfxClip *clip = v->clip;
+	int block, off;
+	u32 bytes;
+
+	*num = clip->len - v->pos;
+	if (clip->pcm)
+		return (clip->pcm + v->pos);
+
+	block = v->pos / clip->block_frames;
+	off = v->pos - block * clip->block_frames;
+	if (v->block != block) {
+		bytes = clip->adpcm_bytes - block * clip->block_bytes;
+		if (bytes > clip->block_bytes) bytes = clip->block_bytes;
+		ima_decode_channel(clip->adpcm + block * clip->block_bytes, bytes, 1, 0, voice_block[i], 1);
+		v->block = block;
+	}
+	if (*num > clip->block_frames - off) *num = clip->block_frames - off;
+	return (voice_block[i] + off);
+}
+
+static void mix_block(u32 *frames, int n, u64 pos)
+{
+	short l[SFX_MIX_BLOCK];
+	short r[SFX_MIX_BLOCK];
+	MixerChannel mix[3];
+	SfxVoice *v;
+	const short *pcm;
+	int i, j, off, len;
+
+	for (i = 0; i < SFX_VOICE_NUM; i++) {
+		v = &voices[i];
+		if (!v->clip) continue;
+
+		off = 0;
+		if (!v->pos) {
+			if (v->at >= pos + n) continue;
+			if (v->at > pos)
+				off = (int)(v->at - pos);
+			else if (v->at != SFX_NOW && v->at < pos)
+				STAT_ADD(late, 1);
+			STAT_ADD(played, 1);
+		}
+		while (v->clip && off < n) {
+			pcm = voice_samples(i, &len);
+			if (len > n - off) len = n - off;
+
+			// the frames pass through at unity on their own side
+			for (j = 0; j < len; j++) {
+				l[j] = (short)(frames[off + j] >> 16);
+				r[j] = (short)frames[off + j];
+			}
+			mix[0].pcm = l;
+			mix[0].gain = MIXER_GAIN_UNITY;
+			mix[0].pan = MIXER_PAN_LEFT;
+			mix[1].pcm = r;
+			mix[1].gain = MIXER_GAIN_UNITY;
+			mix[1].pan = MIXER_PAN_RIGHT;
+			mix[2].pcm = pcm;
+			mix[2].gain = v->gain;
+			mix[2].pan = v->pan;
+			mixer_mix(mix, 3, &frames[off], len);
+
+			off += len;
+			v->pos += len;
+			if (v->pos >= v->clip->len) v->clip = 0;
+		}
+	}
+}
+
+// mixes the voices into frames (L << 16 | R) that the codec plays
+// from sample clock pos on. called by the audio thread just before
+// the frames go to the I2S FIFO
+void sfx_mix(u32 *frames, int n, u64 pos)
+{
+	int i, num;
+
+	if (!sfx_pending(pos + n)) return;
+
+	for (i = 0; i < n; i += num) {
+		num = (n - i < SFX_MIX_BLOCK)? n - i: SFX_MIX_BLOCK;
+		mix_block(&frames[i], num, pos + i);
+	}
+}
@@ -10,9 +10,15 @@
 //#define DEBUG
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <fcntl.h>
 #include <pthread.h>
+#include <sched.h>
+#include <poll.h>
+#include <time.h>
 #include <unistd.h>
+#include <dirent.h>
 #include <sys/ioctl.h>
 #include <sys/time.h>
 #include <sys/mman.h>
@@ -20,9 +26,11 @@
 #include "azplf_hal.h"
 #include "azplf_util.h"
 #include "azplf_audio.h"
+#include "ima_adpcm.h"
 
 static u32 pReg_i2s_drv = 0;
 static int pReg_iic = 0;
+static int i2s_uio_fd = -1;
 
 #define INIT_COUNT		 11*2
 
@@ -45,6 +53,573 @@ u32 page_size;
 // set volume (0 - 15)
 static int volume = 4;
 
+// PCM ring between producers (PSG, WAV) and the audio thread.
+// single producer / single consumer: head is only written by the
+// producer, tail only by the audio thread.
+static u32 ring[AUDIO_RING_SIZE];
+static u32 ring_head = 0;
+static u32 ring_tail = 0;
+static u32 underruns = 0;
+static u32 underruns_reported = 0;	// by the game thread
+static int draining = 0;		// the producer has ended; a dry ring is expected
+
+// counters shared by the producers and the audio thread
+static AudioStats stats;
+static u64 tick_frames = 0;
+static u32 tick_time = 0;
+static u32 dump_time = 0;
+static int dump_interval = 0;		// seconds, 0: off
+
+static pthread_t audio_pt;
+static int audio_running = 0;
+static int audio_quit = 0;
+
+// WAV stream converted to the codec rate
+typedef struct {
+	WavStream file;
+	int resample;
+	Resampler rs[2];		// left, right
+} AudioStream;
+
+static AudioStream stream;
+
+// effects per bus; configured by the game, run by the bus producer
+static FxChain fx_bus[AUDIO_BUS_NUM];
+static pthread_mutex_t fx_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t stream_pt;
+static int stream_started = 0;
+static int stream_playing = 0;
+static int stream_quit = 0;
+
+// the FIFO only reports "full"; from the last time it was full the
+// codec has played at least min(elapsed frames, depth) of it.
+static u64 fifo_full_ns = 0;
+static u32 fifo_written = 0;		// frames written since then
+
+// sample clock: frames played by the codec. it runs on the CPU clock
+// from an anchor that is set whenever the FIFO is found full, because
+// only then the played position is known (fifo_end - depth).
+// the anchor is read under a sequence count, written by the FIFO writer.
+static u32 clock_seq = 0;
+static u64 clock_frames = 0;		// anchor
+static u64 clock_ns = 0;
+static u64 clock_start_ns = 0;
+static u64 clock_last = 0;			// keeps the clock monotonic
+static u64 fifo_end = 0;			// clock position of the next frame written
+static int clock_adjust_max = 0;
+
+// latency control: producers fill up to the target, which rises on an
+// underrun and falls while the lowest latency seen before a refill
+// leaves more than AUDIO_LATENCY_MARGIN of slack
+static int latency_target = AUDIO_LATENCY_DEF;
+static int latency_floor = 0;		// a target that has underrun
+static int latency_low = AUDIO_LATENCY_MAX;	// in the current window
+static int latency_slack = AUDIO_LATENCY_MAX;	// of the last window
+static u64 adapt_clock = 0;
+static u32 adapt_underruns = 0;
+
+static u64 now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((u64)ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+}
+
+static void clock_start(void)
+{
+	u64 now = now_ns();
+
+	__atomic_add_fetch(&clock_seq, 1, __ATOMIC_ACQ_REL);
+	__atomic_store_n(&clock_frames, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&clock_ns, now, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&clock_seq, 1, __ATOMIC_RELEASE);
+	clock_start_ns = now;
+	clock_last = 0;
+	clock_adjust_max = 0;
+	fifo_end = 0;
+}
+
+// clock at now without the monotonic clamp
+static u64 clock_at(u64 now)
+{
+	u64 frames, ns;
+	u32 seq;
+
+	do {
+		seq = __atomic_load_n(&clock_seq, __ATOMIC_ACQUIRE);
+		frames = __atomic_load_n(&clock_frames, __ATOMIC_RELAXED);
+		ns = __atomic_load_n(&clock_ns, __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	} while ((seq & 1) || seq != __atomic_load_n(&clock_seq, __ATOMIC_RELAXED));
+
+	if (!ns || now < ns) return (frames);
+	return (frames + (now - ns) * AUDIO_SAMPLE_RATE / 1000000000ULL);
+}
+
+// the FIFO is full: the codec is exactly depth frames behind fifo_end
+static void clock_anchor(u64 now)
+{
+	u64 frames = (fifo_end > I2SOUT_FIFO_DEPTH)? fifo_end - I2SOUT_FIFO_DEPTH: 0;
+	int adjust = (int)(frames - clock_at(now));
+
+	if (adjust < 0) adjust = -adjust;
+	if (adjust > clock_adjust_max) clock_adjust_max = adjust;
+
+	__atomic_add_fetch(&clock_seq, 1, __ATOMIC_ACQ_REL);
+	__atomic_store_n(&clock_frames, frames, __ATOMIC_RELAXED);
+	__atomic_store_n(&clock_ns, now, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&clock_seq, 1, __ATOMIC_RELEASE);
+}
+
+static inline int i2sout_isfull(void)
+{
+	if (!(i2sout_getstatus(0x0C) & 0xC))
+		return 0;
+	fifo_full_ns = now_ns();
+	fifo_written = 0;
+	clock_anchor(fifo_full_ns);
+	return 1;
+}
+
+// frames played by the codec since i2sout_init (48kHz sample clock)
+u64 azplf_audio_get_clock(void)
+{
+	u64 frames = clock_at(now_ns());
+	u64 last = __atomic_load_n(&clock_last, __ATOMIC_RELAXED);
+
+	// a correction never takes the clock backwards
+	while (frames > last) {
+		if (__atomic_compare_exchange_n(&clock_last, &last, frames, 0,
+				__ATOMIC_RELAXED, __ATOMIC_RELAXED))
+			return (frames);
+	}
+	return (last);
+}
+
+// 1/60 sec game ticks on the sample clock
+u32 azplf_audio_clock_to_tick(u64 frames)
+{
+	return ((u32)(frames / AUDIO_TICK_FRAMES));
+}
+
+u64 azplf_audio_tick_to_clock(u32 tick)
+{
+	return ((u64)tick * AUDIO_TICK_FRAMES);
+}
+
+// frames queued ahead of the clock in the FIFO and the ring
+static int audio_latency(u64 clock)
+{
+	long long queued = (long long)__atomic_load_n(&fifo_end, __ATOMIC_RELAXED) - (long long)clock;
+
+	return (((queued > 0)? (int)queued: 0) + azplf_audio_get_fill());
+}
+
+void azplf_audio_get_sync(AudioSync *sync)
+{
+	u64 now = now_ns();
+
+	sync->clock = azplf_audio_get_clock();
+	sync->wall  = (clock_start_ns)? (now - clock_start_ns) * AUDIO_SAMPLE_RATE / 1000000000ULL: 0;
+	sync->drift_ppm = (sync->wall)? (int)(((long long)sync->clock - (long long)sync->wall) * 1000000 / (long long)sync->wall): 0;
+	sync->latency = audio_latency(sync->clock);
+	sync->adjust_max = clock_adjust_max;
+	sync->target = azplf_audio_get_latency();
+	sync->slack  = latency_slack;
+}
+
+static void set_target(int frames)
+{
+	if (frames < AUDIO_LATENCY_MIN) frames = AUDIO_LATENCY_MIN;
+	if (frames > AUDIO_LATENCY_MAX) frames = AUDIO_LATENCY_MAX;
+	__atomic_store_n(&latency_target, frames, __ATOMIC_RELAXED);
+}
+
+// sets the target latency in frames; it adapts from here
+void azplf_audio_set_latency(int frames)
+{
+	latency_floor = 0;
+	set_target(frames);
+}
+
+int azplf_audio_get_latency(void)
+{
+	return (__atomic_load_n(&latency_target, __ATOMIC_RELAXED));
+}
+
+// the audio thread found the ring dry: a bigger margin is needed.
+// nothing is printed here, the real-time thread must not block on
+// the console; report_underruns tells about it later
+static void raise_latency(void)
+{
+	int target = azplf_audio_get_latency();
+
+	// never come down to this target again
+	if (target > latency_floor) latency_floor = target;
+	set_target(target + target / 2);
+}
+
+// prints the underruns counted since the last report
+static void report_underruns(void)
+{
+	u32 under = azplf_audio_get_underruns();
+
+	if (under == underruns_reported) return;
+	printf("Warning: audio underrun (%u), latency target %d frames.\n",
+		under - underruns_reported, azplf_audio_get_latency());
+	underruns_reported = under;
+}
+
+// frames a producer should queue now to keep the target latency.
+// call it before each refill; the latency seen here is the slack the
+// producer's timing jitter has left, which lets the target come down.
+int azplf_audio_get_request(void)
+{
+	u64 clock = azplf_audio_get_clock();
+	int latency = audio_latency(clock);
+	int target = azplf_audio_get_latency();
+	u32 under = azplf_audio_get_underruns();
+	int n, lower;
+
+	// nothing queued is idle, not jitter; a late refill shows as an underrun
+	if (latency && latency < latency_low) latency_low = latency;
+	if (clock - adapt_clock >= AUDIO_ADAPT_FRAMES) {
+		latency_slack = latency_low;
+		lower = target - (latency_low - AUDIO_LATENCY_MARGIN) / 4;
+		if (lower <= latency_floor) lower = latency_floor + AUDIO_LATENCY_MARGIN;
+		if (under == adapt_underruns && lower < target)
+			set_target(lower);
+		adapt_clock = clock;
+		adapt_underruns = under;
+		latency_low = AUDIO_LATENCY_MAX;
+	}
+
+	n = target - latency;
+	if (n > AUDIO_RING_SIZE - azplf_audio_get_fill())
+		n = AUDIO_RING_SIZE - azplf_audio_get_fill();
+	return ((n > 0)? n: 0);
+}
+
+// writes as many frames as the FIFO can surely take after one status
+// read: one if nothing else is known, or the room made by the codec
+// since the FIFO was last full. returns number of frames written
+size_t i2sout_write_block(const u32 *frames, size_t n)
+{
+	u64 played, now, clock;
+	size_t i, space = 1;
+
+	if (i2sout_isfull())
+		return 0;
+
+	now = now_ns();
+	if (fifo_full_ns) {
+		played = (now - fifo_full_ns) * AUDIO_SAMPLE_RATE / 1000000000ULL;
+		if (played > I2SOUT_FIFO_DEPTH) played = I2SOUT_FIFO_DEPTH;
+		if (played > fifo_written + space) space = played - fifo_written;
+	}
+	if (space > n) space = n;
+
+	// a FIFO that ran dry has played silence up to the clock
+	clock = clock_at(now);
+	if (clock < fifo_end) clock = fifo_end;
+	__atomic_store_n(&fifo_end, clock + space, __ATOMIC_RELAXED);
+
+#ifdef AZPLF_I2S_EMULATION
+	for (i = 0; i < space; i++)
+		i2sout_senddata(4, frames[i]);
+#else
+	for (i = 0; i < space; i++)
+		REG_I2S_OUT(4) = frames[i];
+#endif
+	fifo_written += space;
+	return (space);
+}
+
+int azplf_audio_get_fill(void)
+{
+	return (__atomic_load_n(&ring_head, __ATOMIC_ACQUIRE) -
+			__atomic_load_n(&ring_tail, __ATOMIC_ACQUIRE));
+}
+
+u32 azplf_audio_get_underruns(void)
+{
+	return (__atomic_load_n(&underruns, __ATOMIC_RELAXED));
+}
+
+#define STAT_ADD(field, value)	__atomic_fetch_add(&stats.field, (value), __ATOMIC_RELAXED)
+
+// the counters are updated without a lock, so a snapshot is not
+// exactly consistent between fields
+void azplf_audio_get_stats(AudioStats *result)
+{
+	*result = stats;
+	result->underruns = azplf_audio_get_underruns();
+}
+
+void azplf_audio_reset_stats(void)
+{
+	memset(&stats, 0, sizeof(stats));
+	__atomic_store_n(&underruns, 0, __ATOMIC_RELAXED);
+	underruns_reported = 0;
+	tick_frames = 0;
+}
+
+void azplf_audio_dump_stats(void)
+{
+	AudioStats st;
+	PsgStats psg;
+	AudioSync sync;
+	SfxStats sfx;
+	int i;
+
+	report_underruns();
+	azplf_audio_get_stats(&st);
+	PsgGetStats(&psg);
+
+	printf("[audio] writes=%u frames=%llu underruns=%u fifo_full=%u\n",
+		st.writes, st.frames, st.underruns, st.fifo_full);
+	printf("[audio] fifo wait=%llu us, ring wait=%llu us\n",
+		st.wait_ns / 1000, st.ring_wait_ns / 1000);
+	printf("[audio] ticks=%u short=%u frames/tick min=%d max=%d (need %d)\n",
+		st.ticks, st.tick_short, st.tick_frames_min, st.tick_frames_max, AUDIO_TICK_FRAMES);
+	printf("[audio] ring fill:");
+	for (i = 0; i < AUDIO_STATS_BINS; i++)
+		printf(" %u", st.fill_hist[i]);
+	printf("\n");
+	if (psg.slices) {
+		printf("[psg] slices=%u synth avg=%llu us max=%u us voices max=%d\n",
+			psg.slices, psg.synth_ns / psg.slices / 1000, psg.synth_ns_max / 1000, psg.voices_max);
+	}
+	sfx_get_stats(&sfx);
+	if (sfx.played || sfx.dropped) {
+		printf("[sfx] played=%u late=%u dropped=%u\n", sfx.played, sfx.late, sfx.dropped);
+	}
+	azplf_audio_get_sync(&sync);
+	printf("[clock] frames=%llu wall=%llu drift=%d ppm latency=%d frames adjust max=%d frames\n",
+		sync.clock, sync.wall, sync.drift_ppm, sync.latency, sync.adjust_max);
+	printf("[clock] latency target=%d frames slack=%d frames\n", sync.target, sync.slack);
+}
+
+void azplf_audio_set_stats_dump(int interval_sec)
+{
+	dump_interval = interval_sec;
+}
+
+// called once per game loop with the 1/60 sec system time;
+// checks the frames produced since the last call
+void azplf_audio_stats_tick(u32 system_time)
+{
+	u64 frames = __atomic_load_n(&stats.frames, __ATOMIC_RELAXED);
+	u32 ticks = system_time - tick_time;
+	int per_tick;
+
+	report_underruns();
+	if (!ticks) return;
+	if (tick_time) {
+		per_tick = (int)((frames - tick_frames) / ticks);
+		if (!stats.ticks || per_tick < stats.tick_frames_min) stats.tick_frames_min = per_tick;
+		if (per_tick > stats.tick_frames_max) stats.tick_frames_max = per_tick;
+		if (per_tick < AUDIO_TICK_FRAMES) stats.tick_short += ticks;
+		stats.ticks += ticks;
+	}
+	tick_time = system_time;
+	tick_frames = frames;
+
+	if (dump_interval && system_time - dump_time >= dump_interval * 60) {
+		dump_time = system_time;
+		azplf_audio_dump_stats();
+	}
+}
+
+// push frames (L << 16 | R) to the audio output.
+// blocks until every frame is queued; without the audio thread
+// the frames are written straight to the I2S FIFO.
+int azplf_audio_write(const u32 *frames, int n)
+{
+	u32 head, tail;
+	int i, space, done = 0;
+	u64 t0;
+
+	STAT_ADD(writes, 1);
+	STAT_ADD(frames, n);
+	__atomic_store_n(&draining, 0, __ATOMIC_RELAXED);
+	if (!audio_running) {
+		for (i = 0; i < n; ) {
+			space = i2sout_write_block(&frames[i], n - i);
+			if (!space)
+				i2sout_wait_space(n - i, AUDIO_WAIT_US);
+			i += space;
+		}
+		return (n);
+	}
+
+	head = ring_head;
+	tail = __atomic_load_n(&ring_tail, __ATOMIC_ACQUIRE);
+	STAT_ADD(fill_hist[(head - tail) * AUDIO_STATS_BINS / (AUDIO_RING_SIZE + 1)], 1);
+	while (done < n) {
+		tail = __atomic_load_n(&ring_tail, __ATOMIC_ACQUIRE);
+		space = AUDIO_RING_SIZE - (head - tail);
+		if (!space) {
+			t0 = now_ns();
+			usleep(AUDIO_POLL_US);
+			STAT_ADD(ring_wait_ns, now_ns() - t0);
+			continue;
+		}
+		if (space > n - done) space = n - done;
+		for (i = 0; i < space; i++)
+			ring[(head + i) & (AUDIO_RING_SIZE - 1)] = frames[done + i];
+		head += space;
+		done += space;
+		__atomic_store_n(&ring_head, head, __ATOMIC_RELEASE);
+	}
+	return (done);
+}
+
+// a block that fades the last frame out to silence, so a dry ring does
+// not leave the codec on a step or on whatever the FIFO holds
+static void fadeout_block(u32 *frames, u32 last)
+{
+	short l = (short)(last >> 16);
+	short r = (short)last;
+	int i;
+
+	for (i = 0; i < AUDIO_BLOCK_SIZE; i++) {
+		frames[i] = ((u32)(u16)(l * (AUDIO_BLOCK_SIZE - 1 - i) / AUDIO_BLOCK_SIZE) << 16) |
+					(u16)(r * (AUDIO_BLOCK_SIZE - 1 - i) / AUDIO_BLOCK_SIZE);
+	}
+}
+
+// clock position of the next frame written to the FIFO
+static u64 fifo_position(void)
+{
+	u64 clock = clock_at(now_ns());
+	u64 end = __atomic_load_n(&fifo_end, __ATOMIC_RELAXED);
+
+	return ((clock > end)? clock: end);
+}
+
+// sound effects are mixed into the frames just before they go to the
+// FIFO, where their clock position is known; while the ring is dry the
+// thread writes blocks of its own (a fade out, silence) to carry them
+static void *audio_work_thread(void *arg)
+{
+	u32 block[AUDIO_BLOCK_SIZE];
+	int block_pos = 0, block_num = 0;
+	u32 head, tail;
+	u32 mixed = 0;		// ring frames up to here have the effects
+	u32 last = 0;
+	int playing = 0;
+	int n;
+
+	while (!audio_quit) {
+		if (i2sout_isfull()) {
+			i2sout_wait_space(AUDIO_BLOCK_SIZE, AUDIO_WAIT_US);
+			continue;
+		}
+
+		// an own block goes out first
+		if (block_pos < block_num) {
+			block_pos += i2sout_write_block(&block[block_pos], block_num - block_pos);
+			continue;
+		}
+
+		head = __atomic_load_n(&ring_head, __ATOMIC_ACQUIRE);
+		tail = ring_tail;
+		if (head == tail) {
+			block_num = 0;
+			// the ring ran dry while playing: a late producer is still
+			// in time until the FIFO has played out what it holds
+			if (playing && __atomic_load_n(&fifo_end, __ATOMIC_RELAXED) > azplf_audio_get_clock()) {
+				usleep(AUDIO_POLL_US);
+				continue;
+			}
+			if (playing) {
+				fadeout_block(block, last);
+				block_num = AUDIO_BLOCK_SIZE;
+				if (!__atomic_exchange_n(&draining, 0, __ATOMIC_ACQ_REL)) {
+					__atomic_fetch_add(&underruns, 1, __ATOMIC_RELAXED);
+					raise_latency();
+				}
+				playing = 0;
+			}
+			if (!block_num && sfx_pending(fifo_position() + AUDIO_SFX_LEAD)) {
+				memset(block, 0, sizeof(block));
+				block_num = AUDIO_BLOCK_SIZE;
+			}
+			if (block_num) {
+				sfx_mix(block, block_num, fifo_position());
+				block_pos = 0;
+			} else {
+				usleep(AUDIO_POLL_US);
+			}
+			continue;
+		}
+
+		playing = 1;
+		if ((int)(mixed - tail) < 0) mixed = tail;
+		do {
+			// up to the wrap point of the ring, a block at once
+			n = head - tail;
+			if (n > AUDIO_RING_SIZE - (tail & (AUDIO_RING_SIZE - 1)))
+				n = AUDIO_RING_SIZE - (tail & (AUDIO_RING_SIZE - 1));
+			if (n > AUDIO_BLOCK_SIZE) n = AUDIO_BLOCK_SIZE;
+			if ((int)(tail + n - mixed) > 0) {
+				sfx_mix(&ring[mixed & (AUDIO_RING_SIZE - 1)], tail + n - mixed,
+						fifo_position() + (mixed - tail));
+				mixed = tail + n;
+			}
+			n = i2sout_write_block(&ring[tail & (AUDIO_RING_SIZE - 1)], n);
+			tail += n;
+		} while (n && tail != head);
+		last = ring[(tail - 1) & (AUDIO_RING_SIZE - 1)];
+		__atomic_store_n(&ring_tail, tail, __ATOMIC_RELEASE);
+	}
+
+	return 0;
+}
+
+int azplf_audio_start_thread(void)
+{
+	pthread_attr_t attr;
+	struct sched_param param;
+
+	if (audio_running) return PST_SUCCESS;
+
+	ring_head = 0;
+	ring_tail = 0;
+	underruns = 0;
+	underruns_reported = 0;
+	audio_quit = 0;
+
+	// real-time priority if permitted, otherwise a normal thread
+	pthread_attr_init(&attr);
+	pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+	pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+	param.sched_priority = AUDIO_THREAD_PRIORITY;
+	pthread_attr_setschedparam(&attr, &param);
+	if (pthread_create(&audio_pt, &attr, &audio_work_thread, NULL)) {
+		printf("Warning: audio thread runs without real-time priority.\n");
+		if (pthread_create(&audio_pt, NULL, &audio_work_thread, NULL)) {
+			printf("Error: Audio thread cannot start.\n");
+			pthread_attr_destroy(&attr);
+			return PST_FAILURE;
+		}
+	}
+	pthread_attr_destroy(&attr);
+
+	audio_running = 1;
+	return PST_SUCCESS;
+}
+
+void azplf_audio_stop_thread(void)
+{
+	if (!audio_running) return;
+
+	audio_quit = 1;
+	pthread_join(audio_pt, NULL);
+	audio_running = 0;
+}
+
 void azplf_audio_set_volume(int value)
 {
 	if (value < 0) 
@@ -65,58 +640,322 @@ void azplf_audio_free_wav(WavHeader *wav)
 	free_wavheader(wav);
 }
 
+// 16bit linear PCM: the header points into the mapped file
+static int load_wav_mapped(char *fn, WavHeader *wav)
+{
+	WavView view;
+
+	if (wav_mapfile(&view, fn) != PST_SUCCESS)
+		return 0;
+	if (!view.pcm || view.copy) {
+		wav_unmapfile(&view);
+		return 0;
+	}
+	memset(wav, 0, sizeof(*wav));
+	memcpy(wav->RIFF, "RIFF", 4);
+	memcpy(wav->riff_kind, "WAVE", 4);
+	memcpy(wav->fmt, "fmt ", 4);
+	memcpy(wav->data_chnk, "data", 4);
+	wav->fmt_chnk = 16;
+	wav->fmt_id   = PCM_FORMAT_PCM;
+	wav->Nch      = view.channels;
+	wav->fs       = view.rate;
+	wav->bit      = WAV_BITS;
+	wav->bl_size  = view.channels * sizeof(short);
+	wav->dts      = wav->fs * wav->bl_size;
+	wav->Nbyte    = view.frames * wav->bl_size;
+	wav->data     = (short *)view.pcm;
+	wav->map      = view.map;
+	wav->map_size = view.map_size;
+	return 1;
+}
+
+// samples in the IMA-ADPCM blocks of a loaded file
+static int adpcm_samples(WavHeader *wav)
+{
+	int frames = wav->Nbyte / wav->bl_size * IMA_BLOCK_FRAMES(wav->bl_size, wav->Nch);
+	int rest = wav->Nbyte % wav->bl_size;
+
+	if (rest >= 4 * wav->Nch)
+		frames += IMA_BLOCK_FRAMES(rest, wav->Nch);
+	return (frames * wav->Nch);
+}
+
+static void decode_wav_adpcm(WavHeader *wav, short *data)
+{
+	const u8 *block = (const u8 *)wav->data;
+	u32 left = wav->Nbyte;
+	int bytes;
+
+	while (left >= 4 * wav->Nch) {
+		bytes = (left < wav->bl_size)? left: wav->bl_size;
+		data += ima_decode_block(block, bytes, wav->Nch, data) * wav->Nch;
+		block += bytes;
+		left -= bytes;
+	}
+}
+
+// loads the whole file; samples are converted to 16bit.
+// 16bit PCM is not copied: wav->data is the read only mapped file
 int azplf_audio_load_wav(char *fn, WavHeader *wav)
 {
-	int result;
-	u32 ldata;
-	u32 stat;
-	int i;
-	float sdata;
+	int num;
+	short *data;
+
+	if (load_wav_mapped(fn, wav))
+		return 1;
+	if (wav_readfile(wav, fn /*"test.wav"*/) != PST_SUCCESS)
+		return 0;
+	if (wav->bit == WAV_BITS && wav->fmt_id == PCM_FORMAT_PCM)
+		return 1;
 
-	result = wav_readfile(wav, fn /*"test.wav"*/);
-	if (wav->bit != WAV_BITS)
+	if (wav->fmt_id == WAV_FORMAT_IMA_ADPCM && wav->Nch && wav->bl_size >= 4 * wav->Nch)
+		num = adpcm_samples(wav);
+	else if (pcm_supported(wav->fmt_id, wav->bit))
+		num = wav->Nbyte / (wav->bit / 8);
+	else
 	{
-		printf("Error: bit width is not 16.\r\n");
+		printf("Error: WAV format %d with %d bits is not supported.\r\n", wav->fmt_id, wav->bit);
 		azplf_audio_free_wav(wav);
 		return 0;
 	}
-
+	data = (short *)malloc(num * sizeof(short));
+	if (!data)
+	{
+		printf("Error: Cannot allocate WAV data.\r\n");
+		azplf_audio_free_wav(wav);
+		return 0;
+	}
+	if (wav->fmt_id == WAV_FORMAT_IMA_ADPCM)
+		decode_wav_adpcm(wav, data);
+	else
+		pcm_to_s16(wav->data, wav->fmt_id, wav->bit, data, num);
+	free(wav->data);
+	wav->data    = data;
+	wav->Nbyte   = num * sizeof(short);
+	wav->fmt_id  = PCM_FORMAT_PCM;
+	wav->bit     = WAV_BITS;
+	wav->bl_size = wav->Nch * sizeof(short);
+	wav->dts     = wav->fs * wav->bl_size;
 	return 1;
 }
 
-void PlayWavFile(char *fn)
+// runs the effects of a bus over frames; a bus without effects or
+// bypassed costs only the flag check
+void azplf_audio_process_fx(int bus, u32 *frames, int n)
+{
+	FxChain *fx = &fx_bus[bus];
+
+	if (!__atomic_load_n(&fx->flags, __ATOMIC_RELAXED) ||
+		__atomic_load_n(&fx->bypass, __ATOMIC_RELAXED))
+		return;
+	pthread_mutex_lock(&fx_mutex);
+	fx_process(fx, frames, n);
+	pthread_mutex_unlock(&fx_mutex);
+}
+
+static int fx_valid(int bus)
+{
+	if (bus >= 0 && bus < AUDIO_BUS_NUM) return 1;
+	printf("Error: Audio bus %d does not exist.\n", bus);
+	return 0;
+}
+
+void azplf_audio_set_hpf(int bus, int cutoff)
+{
+	if (!fx_valid(bus)) return;
+	pthread_mutex_lock(&fx_mutex);
+	fx_set_hpf(&fx_bus[bus], cutoff);
+	pthread_mutex_unlock(&fx_mutex);
+}
+
+void azplf_audio_set_lpf(int bus, int cutoff)
+{
+	if (!fx_valid(bus)) return;
+	pthread_mutex_lock(&fx_mutex);
+	fx_set_lpf(&fx_bus[bus], cutoff);
+	pthread_mutex_unlock(&fx_mutex);
+}
+
+int azplf_audio_set_echo(int bus, int delay_ms, int feedback, int mix)
 {
 	int result;
-	WavHeader wavheader;
-	u32 ldata;
-	u32 stat;
-	int i;
-	float sdata;
 
-	result = wav_readfile(&wavheader, fn /*"test.wav"*/);
-	if (wavheader.bit != WAV_BITS)
-	{
-		printf("Error: bit width is not 16.\r\n");
-		return 0;
+	if (!fx_valid(bus)) return PST_FAILURE;
+	pthread_mutex_lock(&fx_mutex);
+	result = fx_set_echo(&fx_bus[bus], delay_ms, feedback, mix);
+	pthread_mutex_unlock(&fx_mutex);
+	return (result);
+}
+
+int azplf_audio_set_reverb(int bus, int room, int mix)
+{
+	int result;
+
+	if (!fx_valid(bus)) return PST_FAILURE;
+	pthread_mutex_lock(&fx_mutex);
+	result = fx_set_reverb(&fx_bus[bus], room, mix);
+	pthread_mutex_unlock(&fx_mutex);
+	return (result);
+}
+
+// bypass keeps the settings; the delay lines are cleared for a clean restart
+void azplf_audio_bypass_fx(int bus, int bypass)
+{
+	if (!fx_valid(bus)) return;
+	pthread_mutex_lock(&fx_mutex);
+	if (!bypass && fx_bus[bus].bypass) fx_reset(&fx_bus[bus]);
+	fx_bus[bus].bypass = bypass;
+	pthread_mutex_unlock(&fx_mutex);
+}
+
+static int audio_openstream(AudioStream *stream, char *fn)
+{
+	if (wav_openstream(&stream->file, fn) != PST_SUCCESS)
+		return PST_FAILURE;
+
+	// other rates are converted to the codec rate while streaming
+	stream->resample = (stream->file.header.fs != AUDIO_SAMPLE_RATE);
+	if (stream->resample) {
+		resampler_init(&stream->rs[0], stream->file.header.fs, AUDIO_SAMPLE_RATE, AUDIO_RESAMPLE_MODE);
+		resampler_init(&stream->rs[1], stream->file.header.fs, AUDIO_SAMPLE_RATE, AUDIO_RESAMPLE_MODE);
 	}
-	for (i = 0; i < wavheader.Nbyte/2; i++)
-	{
-		while ((stat = i2sout_getstatus(0x0C) & 0xC));
-
-		sdata = wavheader.data[i];
-		sdata = sdata * (volume + 1) / 16.0; // attenuator
-		// bit debug[0] inverts the MSB of I2S data
-		ldata = (u32)sdata;
-		ldata = ((ldata & 0xFFFF) << 16) | (ldata & 0xFFFF);
-#if defined(_DEBUG)
-		if (i < 64)
-		{
-			printf("out_aud: %08x\r\n", (u32)ldata);
+	return PST_SUCCESS;
+}
+
+// reads a block of the stream and converts it into I2S frames
+// (up to max, at most AUDIO_STREAM_BLOCK). returns number of frames, 0 at the end of the file
+static int stream_block(AudioStream *stream, u32 *frames, int max)
+{
+	short pcm[AUDIO_STREAM_BLOCK * 2];
+	short pcm_l[AUDIO_STREAM_BLOCK];
+	short pcm_r[AUDIO_STREAM_BLOCK];
+	short rs_l[AUDIO_STREAM_BLOCK];
+	short rs_r[AUDIO_STREAM_BLOCK];
+	WavHeader *header = &stream->file.header;
+	MixerChannel mix[2];
+	int n, num;
+	int out_n;
+
+	if (max > AUDIO_STREAM_BLOCK) max = AUDIO_STREAM_BLOCK;
+	num = max;
+	// input frames that give at most max output frames
+	if (stream->resample) {
+		num = (int)((u64)(max - 2) * header->fs / AUDIO_SAMPLE_RATE);
+		if (num > AUDIO_STREAM_BLOCK) num = AUDIO_STREAM_BLOCK;
+		if (num < 1) num = 1;
+	}
+	// pcm holds num * Nch samples; more than two channels mean fewer frames
+	if (num > AUDIO_STREAM_BLOCK * 2 / header->Nch)
+		num = AUDIO_STREAM_BLOCK * 2 / header->Nch;
+
+	do {
+		n = wav_readstream(&stream->file, pcm, num);
+		if (!n) return 0;
+
+		mix[0].pcm = pcm;
+		mix[1].pcm = 0;
+		if (header->Nch > 1) {
+			// first two channels as left and right
+			pcm_deinterleave(pcm, header->Nch, pcm_l, pcm_r, n);
+			mix[0].pcm = pcm_l;
+			mix[1].pcm = pcm_r;
 		}
-#endif
-		i2sout_senddata(4, ldata);
+
+		out_n = n;
+		if (stream->resample) {
+			out_n = resampler_process(&stream->rs[0], mix[0].pcm, n, rs_l, AUDIO_STREAM_BLOCK);
+			mix[0].pcm = rs_l;
+			if (mix[1].pcm) {
+				resampler_process(&stream->rs[1], mix[1].pcm, n, rs_r, AUDIO_STREAM_BLOCK);
+				mix[1].pcm = rs_r;
+			}
+		}
+	} while (!out_n); // the resampler may still be filling its history
+
+	mix[0].gain = mix[1].gain = mixer_vol_curve[volume]; // attenuator
+	if (!mix[1].pcm) {
+		mix[0].pan = MIXER_PAN_CENTER;
+		mixer_mix(mix, 1, frames, out_n);
+	} else {
+		mix[0].pan = MIXER_PAN_LEFT;
+		mix[1].pan = MIXER_PAN_RIGHT;
+		mixer_mix(mix, 2, frames, out_n);
 	}
-	free_wavheader(&wavheader);
+	azplf_audio_process_fx(AUDIO_BUS_WAV, frames, out_n);
+	return (out_n);
+}
+
+void PlayWavFile(char *fn)
+{
+	AudioStream stream;
+	u32 frames[AUDIO_STREAM_BLOCK];
+	int n;
+
+	if (audio_openstream(&stream, fn) != PST_SUCCESS)
+		return;
+	while ((n = stream_block(&stream, frames, AUDIO_STREAM_BLOCK)) > 0)
+		azplf_audio_write(frames, n);
+	wav_closestream(&stream.file);
+}
+
+// background reader: keeps the output at the target latency, reading
+// the file once at least AUDIO_BLOCK_SIZE frames are wanted
+static void *audio_stream_thread(void *arg)
+{
+	u32 frames[AUDIO_STREAM_BLOCK];
+	int n;
+
+	while (!stream_quit) {
+		n = azplf_audio_get_request();
+		if (n < AUDIO_BLOCK_SIZE) {
+			usleep((AUDIO_BLOCK_SIZE - n) * 1000 / 48 + 1);
+			continue;
+		}
+		if ((n = stream_block(&stream, frames, n)) <= 0) break;
+		azplf_audio_write(frames, n);
+	}
+	__atomic_store_n(&draining, 1, __ATOMIC_RELEASE);
+
+	wav_closestream(&stream.file);
+	__atomic_store_n(&stream_playing, 0, __ATOMIC_RELEASE);
+	return 0;
+}
+
+// starts streaming a 16bit WAV file into the audio output.
+// memory use does not depend on the file length. the stream is the
+// only producer of azplf_audio_write until it ends or is stopped.
+int azplf_audio_play_stream(char *fn)
+{
+	azplf_audio_stop_stream();
+
+	if (audio_openstream(&stream, fn) != PST_SUCCESS)
+		return PST_FAILURE;
+
+	stream_quit = 0;
+	stream_playing = 1;
+	if (pthread_create(&stream_pt, NULL, &audio_stream_thread, NULL)) {
+		printf("Error: WAV stream thread cannot start.\n");
+		wav_closestream(&stream.file);
+		stream_playing = 0;
+		return PST_FAILURE;
+	}
+	stream_started = 1;
+	return PST_SUCCESS;
+}
+
+void azplf_audio_stop_stream(void)
+{
+	if (!stream_started) return;
+
+	stream_quit = 1;
+	pthread_join(stream_pt, NULL);
+	stream_started = 0;
+}
+
+int azplf_audio_stream_playing(void)
+{
+	return (__atomic_load_n(&stream_playing, __ATOMIC_ACQUIRE));
 }
 
 void azplf_audio_init(void)
@@ -127,6 +966,13 @@ void azplf_audio_init(void)
 
 void azplf_audio_deinit(void)
 {
+	int bus;
+
+	azplf_audio_stop_stream();
+	azplf_audio_stop_thread();
+	for (bus = 0; bus < AUDIO_BUS_NUM; bus++)
+		fx_free(&fx_bus[bus]);
+	sfx_unload_all();
 	i2c_deinit();
 	i2sout_deinit();
 }
@@ -178,20 +1024,115 @@ void i2c_deinit(void)
 	close(pReg_iic);
 }
 
+#ifdef AZPLF_I2S_EMULATION
+
+// host build: the FIFO is a counter drained at 48kHz by the clock
+static u32 emu_level = 0;
+static u64 emu_last_ns = 0;
+static u64 emu_rem = 0;
+
+static void emu_drain(void)
+{
+	u64 now = now_ns();
+	u64 played;
+
+	emu_rem += (now - emu_last_ns) * 48000;
+	emu_last_ns = now;
+	played = emu_rem / 1000000000ULL;
+	emu_rem -= played * 1000000000ULL;
+	if (played >= emu_level) {
+		emu_level = 0;
+		emu_rem = 0; // the codec does not play ahead while empty
+	} else {
+		emu_level -= played;
+	}
+}
+
+void i2sout_init(void)
+{
+	clock_start();
+	emu_level = 0;
+	emu_rem = 0;
+	emu_last_ns = now_ns();
+	printf("I2S output is emulated (%d frames FIFO).\n", I2SOUT_FIFO_DEPTH);
+}
+
+void i2sout_deinit(void)
+{
+}
+
+void i2sout_senddata(u32 address, u32 data)
+{
+	if (address != 4) return;
+	emu_drain();
+	if (emu_level < I2SOUT_FIFO_DEPTH) emu_level++;
+}
+
+u32 i2sout_getstatus(u32 address)
+{
+	if (address != 0x0C) return 0;
+	emu_drain();
+	return ((emu_level >= I2SOUT_FIFO_DEPTH)? 0xC: 0);
+}
+
+#else
+
+// UIO devices are numbered in probe order, so the interrupt is looked
+// up by the name the device tree gives it
+static int i2sout_open_uio(const char *name)
+{
+	DIR *dir;
+	struct dirent *ent;
+	FILE *fp;
+	char path[300];
+	char buf[64];
+	int fd = -1;
+
+	dir = opendir("/sys/class/uio");
+	if (!dir) return (-1);
+	while (fd < 0 && (ent = readdir(dir)) != NULL) {
+		if (strncmp(ent->d_name, "uio", 3)) continue;
+		snprintf(path, sizeof(path), "/sys/class/uio/%s/name", ent->d_name);
+		fp = fopen(path, "r");
+		if (!fp) continue;
+		if (fgets(buf, sizeof(buf), fp)) {
+			buf[strcspn(buf, "\n")] = 0;
+			if (!strcmp(buf, name)) {
+				snprintf(path, sizeof(path), "/dev/%s", ent->d_name);
+				fd = open(path, O_RDWR);
+			}
+		}
+		fclose(fp);
+	}
+	closedir(dir);
+	return (fd);
+}
+
 void i2sout_init(void)
 {
 	int fd;
+
+	clock_start();
 	page_size = sysconf(_SC_PAGESIZE);
 	printf("File page size=0x%08x (%dKB)\n", page_size, page_size>>10);
 	fd = open("/dev/mem", O_RDWR);
 	pReg_i2s_drv = (u32)mmap(NULL, page_size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, I2SOUT_BASEADDR);
 	printf("Mapping I/O: 0x%08x to vmem: 0x%08x\n", I2SOUT_BASEADDR, pReg_i2s_drv);
 	close(fd);
+
+	// without the interrupt the waits fall back to timed sleeps
+	i2s_uio_fd = i2sout_open_uio(I2SOUT_UIO_NAME);
+	if (i2s_uio_fd < 0)
+		printf("Warning: UIO device %s is not available, FIFO waits use sleeps.\n", I2SOUT_UIO_NAME);
 }
 
 void i2sout_deinit(void)
 {
 	//Deinitialize the I2S Output Driver
+	if (i2s_uio_fd >= 0) {
+		close(i2s_uio_fd);
+		i2s_uio_fd = -1;
+	}
 	if (pReg_i2s_drv) munmap((void *)pReg_i2s_drv, page_size);
 }
 
@@ -205,3 +1146,58 @@ u32 i2sout_getstatus(u32 address)
 	return (REG_I2S_OUT(address));
 }
 
+#endif
+
+// blocks on the FIFO half-empty interrupt; returns 0 on timeout or error
+static int i2sout_wait_irq(int timeout_us)
+{
+	struct pollfd pfd;
+	u32 info = 1;
+
+	// UIO interrupts are re-armed by writing 1
+	if (write(i2s_uio_fd, &info, sizeof(info)) != sizeof(info))
+		return 0;
+	pfd.fd = i2s_uio_fd;
+	pfd.events = POLLIN;
+	if (poll(&pfd, 1, (timeout_us + 999) / 1000) <= 0)
+		return 0;
+	return (read(i2s_uio_fd, &info, sizeof(info)) == sizeof(info));
+}
+
+// waits until the FIFO can take n more frames (up to half of
+// I2SOUT_FIFO_DEPTH, so the codec never runs dry while we sleep).
+// the interrupt fires at half empty; the fallback sleeps for as long
+// as the codec needs to play n frames.
+// returns PST_SUCCESS, or PST_FAILURE if the FIFO stayed full until timeout
+int i2sout_wait_space(int n, int timeout_us)
+{
+	int waited = 0;
+	int sleep_us;
+	int result = PST_FAILURE;
+	u64 t0;
+
+	if (!i2sout_isfull())
+		return PST_SUCCESS;
+
+	STAT_ADD(fifo_full, 1);
+	t0 = now_ns();
+	if (i2s_uio_fd >= 0 && i2sout_wait_irq(timeout_us)) {
+		STAT_ADD(wait_ns, now_ns() - t0);
+		return PST_SUCCESS;
+	}
+
+	if (n < 1) n = 1;
+	if (n > I2SOUT_FIFO_DEPTH / 2) n = I2SOUT_FIFO_DEPTH / 2;
+	sleep_us = n * 1000 / 48 + 1;
+	while (waited < timeout_us) {
+		usleep(sleep_us);
+		waited += sleep_us;
+		if (!i2sout_isfull()) {
+			result = PST_SUCCESS;
+			break;
+		}
+		sleep_us = 1000 / 48 + 1; // a frame at a time once drained
+	}
+	STAT_ADD(wait_ns, now_ns() - t0);
+	return (result);
+}
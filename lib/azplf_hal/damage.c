@@ -0,0 +1,108 @@
+/******************************************************
+ *    Filename:     damage.c
+ *     Purpose:     dirty rectangles of a frame buffer
+ *  Target Plf:     Linux host / ZYBO (azplf)
+ *  Created on: 	2026/10/17
+ * Modified on:
+ *      Author: 	atsupi.com
+ *     Version:		0.90
+ ******************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include "azplf_bsp.h"
+#include "damage.h"
+
+static u32 rect_area(const DamageRect *r)
+{
+	return ((u32)(r->x2 - r->x1 + 1) * (r->y2 - r->y1 + 1));
+}
+
+static void rect_union(DamageRect *dst, const DamageRect *a, const DamageRect *b)
+{
+	dst->x1 = (a->x1 < b->x1)? a->x1: b->x1;
+	dst->y1 = (a->y1 < b->y1)? a->y1: b->y1;
+	dst->x2 = (a->x2 > b->x2)? a->x2: b->x2;
+	dst->y2 = (a->y2 > b->y2)? a->y2: b->y2;
+}
+
+static void remove_rect(DamageRegion *dmg, int i)
+{
+	dmg->rects[i] = dmg->rects[--dmg->num];
+}
+
+void damage_init(DamageRegion *dmg, u32 fb)
+{
+	dmg->fb = fb;
+	dmg->num = 0;
+}
+
+void damage_clear(DamageRegion *dmg)
+{
+	dmg->num = 0;
+}
+
+// rectangles whose bounding box costs no more pixels than the two are
+// merged, so overlapping glyphs or tiles become one redraw; when the
+// list is full the cheapest pair is merged
+void damage_add(DamageRegion *dmg, int x1, int y1, int x2, int y2)
+{
+	DamageRect r, u;
+	int cost, best_cost;
+	int i, j, best_i, best_j;
+
+	if (x1 < 0) x1 = 0;
+	if (y1 < 0) y1 = 0;
+	if (x2 >= DISP_WIDTH)  x2 = DISP_WIDTH - 1;
+	if (y2 >= DISP_HEIGHT) y2 = DISP_HEIGHT - 1;
+	if (x1 > x2 || y1 > y2) return;
+	r.x1 = x1; r.y1 = y1; r.x2 = x2; r.y2 = y2;
+
+	// a merged rectangle may now take in others
+	for (i = 0; i < dmg->num; ) {
+		rect_union(&u, &r, &dmg->rects[i]);
+		if (rect_area(&u) <= rect_area(&r) + rect_area(&dmg->rects[i])) {
+			r = u;
+			remove_rect(dmg, i);
+			i = 0;
+			continue;
+		}
+		i++;
+	}
+
+	if (dmg->num == DAMAGE_RECT_MAX) {
+		best_i = best_j = 0;
+		best_cost = DISP_WIDTH * DISP_HEIGHT;
+		for (i = 0; i < dmg->num; i++) {
+			for (j = i + 1; j < dmg->num; j++) {
+				rect_union(&u, &dmg->rects[i], &dmg->rects[j]);
+				cost = (int)rect_area(&u) - (int)rect_area(&dmg->rects[i]) - (int)rect_area(&dmg->rects[j]);
+				if (cost < best_cost) {
+					best_cost = cost;
+					best_i = i;
+					best_j = j;
+				}
+			}
+		}
+		rect_union(&dmg->rects[best_i], &dmg->rects[best_i], &dmg->rects[best_j]);
+		remove_rect(dmg, best_j);
+	}
+	dmg->rects[dmg->num++] = r;
+}
+
+void damage_add_all(DamageRegion *dmg)
+{
+	dmg->num = 0;
+	damage_add(dmg, 0, 0, DISP_WIDTH - 1, DISP_HEIGHT - 1);
+}
+
+// pixels covered; the rectangles may still overlap a little
+u32 damage_area(const DamageRegion *dmg)
+{
+	u32 area = 0;
+	int i;
+
+	for (i = 0; i < dmg->num; i++)
+		area += rect_area(&dmg->rects[i]);
+	return (area);
+}
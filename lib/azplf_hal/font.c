@@ -38,7 +38,7 @@ void drawText(u32 dest_fb, u16 x, u16 y, u8 *str)
 		if (ch > 222) ch = 14; //('.' - 32)
 		src_x = (ch % 16) * FONT_WIDTH + l_fontBasePos.x;
 		src_y = (ch & 0xF0) + l_fontBasePos.y;
-		gfxaccel_bitblt(l_ptGfxaccel, 
+		gfxaccel_submit_bitblt(l_ptGfxaccel, 
 			l_resAddr, src_x, src_y, 16, 16,
 			dest_fb, x, y, GFXACCEL_BB_NONE);
 		x += FONT_WIDTH;
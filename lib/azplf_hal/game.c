@@ -11,7 +11,6 @@
 
 #include <stdio.h>
 #include <pthread.h>
-#include <sys/time.h>
 #include "azplf_hal.h"
 #include "azplf_util.h"
 
@@ -20,7 +19,6 @@ static int game_quit = 0;
 static int game_initialized = 0;
 
 static u32 system_time = 0; // 1/60 sec unit
-struct timeval start_time;
 static pthread_mutex_t mutex;
 
 static int scene = 0;
@@ -29,42 +27,23 @@ static int next_scene = 0;
 
 static fb_render_handler fb_handler = NULL;
 
-static u32 ProcessTime(void)
+// the audio sample clock is the master timebase: a tick is
+// AUDIO_TICK_FRAMES frames played by the codec, so video stays locked
+// to the audio however the CPU clock drifts.
+// returns frames left until the next tick
+static int ProcessTime(void)
 {
-	static u32 old_time = 0;
-	struct timeval curr_time;
-	float duration; // us unit
+	u64 clock = azplf_audio_get_clock();
 
 	game_lock_mutex();
-	gettimeofday(&curr_time, NULL);
-#ifdef DEBUG
-	printf("current time=%d:%d\n", (int)curr_time.tv_sec, (int)curr_time.tv_usec);
-#endif
-	duration = (curr_time.tv_sec - start_time.tv_sec) * 1000000.0 + (curr_time.tv_usec - start_time.tv_usec);
-	duration -= system_time * 16666.7;
-
-	system_time += duration / 16666.7;
-	if (system_time == 0xffffffff) {
-		printf("system time is negative\n");
-		// system time is modified after booting
-		// reset start_time with current time
-		gettimeofday(&start_time, NULL);
-		system_time = 0;
-		old_time = 0;
-	}
+	system_time = azplf_audio_clock_to_tick(clock);
 	game_unlock_mutex();
 
-	if (system_time - old_time >= 59) {
 #ifdef DEBUG
+	if (system_time % 60 == 0)
 		printf("%d\n", system_time / 60);
 #endif
-		old_time = system_time;
-	}
-	if (duration < 60 * 1000 && duration >= 16) {
-		return (system_time);
-	}
-
-	return 0;
+	return ((int)(azplf_audio_tick_to_clock(system_time + 1) - clock));
 }
 
 static int SceneChangeCheck(void)
@@ -145,16 +124,22 @@ void game_set_fb_renderer(fb_render_handler handler)
 
 void *game_work_thread(void *arg)
 {
-	gettimeofday(&start_time, NULL);
+	u32 prev_time = 0;
+	int wait;
 
 	printf("Loop starts.\r\n");
 	while (!game_quit) {
-		if (ProcessTime()) {
+		wait = ProcessTime();
+		if (game_get_systemtime() != prev_time) {
+			prev_time = game_get_systemtime();
 			SceneChangeCheck();
 			if (fb_handler)
 				fb_handler(game_get_scene());
+			azplf_audio_stats_tick(prev_time);
+			wait = ProcessTime();
 		}
-		usleep(5000); // 5ms wait
+		// sleep until the next tick on the sample clock
+		usleep(wait * 1000 / 48 + 1);
 	}
 
 	return 0;
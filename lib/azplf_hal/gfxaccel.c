@@ -10,8 +10,11 @@
 //#define DEBUG
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <stdint.h>
+#include <time.h>
 #include <sys/mman.h>
 #include <fcntl.h>
 #include "azplf_bsp.h"
@@ -49,6 +52,15 @@ u32 gfxaccel_init(GfxaccelInstance *inst, u32 baseAddr)
 	u32 result;
 
 	inst->baseAddress = baseAddr;
+	inst->backend = GFXACCEL_BACKEND_HW;
+	inst->soft_mem = 0;
+	inst->queue = 0;
+	inst->running = 0;
+	inst->head = inst->tail = inst->done = 0;
+	inst->recording = 0;
+	inst->damage = 0;
+	inst->shadow_valid = 0;
+	memset(&inst->stats, 0, sizeof(inst->stats));
 	printf("In gfxaccel_init()\n");
 	page_size = sysconf(_SC_PAGESIZE);
 	printf("File page size=0x%08x (%dKB)\n", page_size, page_size>>10);
@@ -70,6 +82,12 @@ u32 gfxaccel_init(GfxaccelInstance *inst, u32 baseAddr)
 
 void gfxaccel_deinit(GfxaccelInstance *inst)
 {
+	gfxaccel_stop_queue(inst);
+	if (inst->backend == GFXACCEL_BACKEND_SOFT) {
+		free(inst->soft_mem);
+		inst->soft_mem = 0;
+		return;
+	}
 	if (inst->virtAddress)
 		munmap((void *)inst->virtAddress, page_size);
 }
@@ -102,6 +120,8 @@ u32 gfxaccel_isidle(GfxaccelInstance *inst)
 {
     u32 Data;
 
+	if (inst->backend == GFXACCEL_BACKEND_SOFT) return 1;
+
     Data = gfxaccel_read_reg(inst->virtAddress, GFXACCEL_CONTROL_ADDR_AP_CTRL);
     return (Data >> 2) & 0x1;
 }
@@ -110,87 +130,134 @@ u32 gfxaccel_isready(GfxaccelInstance *inst)
 {
     u32 Data;
 
+	if (inst->backend == GFXACCEL_BACKEND_SOFT) return 1;
+
     Data = gfxaccel_read_reg(inst->virtAddress, GFXACCEL_CONTROL_ADDR_AP_CTRL);
     // check ap_start to see if the pcore is ready for next input
     return !(Data & 0x1);
 }
 
+// the argument registers keep their value between operations, so a
+// value the IP already holds is not written again. the soft backend
+// keeps the shadow too and counts the writes the IP would take
+static void gfxaccel_set_arg(GfxaccelInstance *inst, int arg, u32 offset, u32 Data)
+{
+	if ((inst->shadow_valid & (1 << arg)) && inst->shadow[arg] == Data) {
+		GFXACCEL_STAT_ADD(&inst->stats, reg_elided, 1);
+		return;
+	}
+	if (inst->backend != GFXACCEL_BACKEND_SOFT)
+		gfxaccel_write_reg(inst->virtAddress, offset, Data);
+	inst->shadow[arg] = Data;
+	inst->shadow_valid |= 1 << arg;
+	GFXACCEL_STAT_ADD(&inst->stats, reg_writes, 1);
+}
+
 static void gfxaccel_set_src_fb(GfxaccelInstance *inst, u32 Data)
 {
-    gfxaccel_write_reg(inst->virtAddress, GFXACCEL_CONTROL_ADDR_SRC_FB_DATA, Data);
+    gfxaccel_set_arg(inst, GFXACCEL_ARG_SRC_FB, GFXACCEL_CONTROL_ADDR_SRC_FB_DATA, Data);
 }
 
 static void gfxaccel_set_x1(GfxaccelInstance *inst, u32 Data)
 {
-    gfxaccel_write_reg(inst->virtAddress, GFXACCEL_CONTROL_ADDR_X1_DATA, Data);
+    gfxaccel_set_arg(inst, GFXACCEL_ARG_X1, GFXACCEL_CONTROL_ADDR_X1_DATA, Data);
 }
 
 static void gfxaccel_set_y1(GfxaccelInstance *inst, u32 Data)
 {
-    gfxaccel_write_reg(inst->virtAddress, GFXACCEL_CONTROL_ADDR_Y1_DATA, Data);
+    gfxaccel_set_arg(inst, GFXACCEL_ARG_Y1, GFXACCEL_CONTROL_ADDR_Y1_DATA, Data);
 }
 
 static void gfxaccel_set_dx(GfxaccelInstance *inst, u32 Data)
 {
-    gfxaccel_write_reg(inst->virtAddress, GFXACCEL_CONTROL_ADDR_DX_DATA, Data);
+    gfxaccel_set_arg(inst, GFXACCEL_ARG_DX, GFXACCEL_CONTROL_ADDR_DX_DATA, Data);
 }
 
 static void gfxaccel_set_dy(GfxaccelInstance *inst, u32 Data)
 {
-    gfxaccel_write_reg(inst->virtAddress, GFXACCEL_CONTROL_ADDR_DY_DATA, Data);
+    gfxaccel_set_arg(inst, GFXACCEL_ARG_DY, GFXACCEL_CONTROL_ADDR_DY_DATA, Data);
 }
 
 static void gfxaccel_set_dst_fb(GfxaccelInstance *inst, u32 Data)
 {
-    gfxaccel_write_reg(inst->virtAddress, GFXACCEL_CONTROL_ADDR_DST_FB_DATA, Data);
+    gfxaccel_set_arg(inst, GFXACCEL_ARG_DST_FB, GFXACCEL_CONTROL_ADDR_DST_FB_DATA, Data);
 }
 
 static void gfxaccel_set_x2(GfxaccelInstance *inst, u32 Data)
 {
-    gfxaccel_write_reg(inst->virtAddress, GFXACCEL_CONTROL_ADDR_X2_DATA, Data);
+    gfxaccel_set_arg(inst, GFXACCEL_ARG_X2, GFXACCEL_CONTROL_ADDR_X2_DATA, Data);
 }
 
 static void gfxaccel_set_y2(GfxaccelInstance *inst, u32 Data)
 {
-    gfxaccel_write_reg(inst->virtAddress, GFXACCEL_CONTROL_ADDR_Y2_DATA, Data);
+    gfxaccel_set_arg(inst, GFXACCEL_ARG_Y2, GFXACCEL_CONTROL_ADDR_Y2_DATA, Data);
 }
 
 static void gfxaccel_set_col(GfxaccelInstance *inst, u32 Data)
 {
-    gfxaccel_write_reg(inst->virtAddress, GFXACCEL_CONTROL_ADDR_COL_DATA, Data);
+    gfxaccel_set_arg(inst, GFXACCEL_ARG_COL, GFXACCEL_CONTROL_ADDR_COL_DATA, Data);
 }
 
 static void gfxaccel_set_mode(GfxaccelInstance *inst, u32 Data)
 {
-    gfxaccel_write_reg(inst->virtAddress, GFXACCEL_CONTROL_ADDR_MODE_DATA, Data);
+    gfxaccel_set_arg(inst, GFXACCEL_ARG_MODE, GFXACCEL_CONTROL_ADDR_MODE_DATA, Data);
 }
 
 static void gfxaccel_set_op(GfxaccelInstance *inst, u32 Data)
 {
-    gfxaccel_write_reg(inst->virtAddress, GFXACCEL_CONTROL_ADDR_OP_DATA, Data);
+    gfxaccel_set_arg(inst, GFXACCEL_ARG_OP, GFXACCEL_CONTROL_ADDR_OP_DATA, Data);
 }
 
-static void HwIpGfxaccel(GfxaccelInstance *inst, u32 src_fb, u16 x1, u16 y1, u16 dx, u16 dy, u32 dst_fb, u16 x2, u16 y2, u32 col, u8 mode, u8 op)
+// pixels an operation writes
+static u32 gfxaccel_cmd_pixels(const GfxaccelCmd *cmd)
 {
-	gfxaccel_set_src_fb(inst, src_fb);
-	gfxaccel_set_dst_fb(inst, dst_fb);
-	gfxaccel_set_mode(inst, mode); // mode
-	gfxaccel_set_op(inst, op); // op
-	gfxaccel_set_col(inst, col); // col
-	gfxaccel_set_x1(inst, x1); // x1
-	gfxaccel_set_y1(inst, y1); // y1
-	gfxaccel_set_dx(inst, dx); // dx
-	gfxaccel_set_dy(inst, dy); // dy
-	gfxaccel_set_x2(inst, x2); // x2
-	gfxaccel_set_y2(inst, y2); // y2
+	int dx, dy;
+
+	switch (cmd->mode) {
+	case GFXACCEL_MODE_FILLRECT:
+		if (cmd->x1 > cmd->x2 || cmd->y1 > cmd->y2) return 0;
+		return ((u32)(cmd->x2 - cmd->x1 + 1) * (cmd->y2 - cmd->y1 + 1));
+	case GFXACCEL_MODE_LINE:
+		dx = (cmd->x2 > cmd->x1)? cmd->x2 - cmd->x1: cmd->x1 - cmd->x2;
+		dy = (cmd->y2 > cmd->y1)? cmd->y2 - cmd->y1: cmd->y1 - cmd->y2;
+		return ((dx > dy)? dx + 1: dy + 1);
+	case GFXACCEL_MODE_BITBLT:
+		return ((u32)cmd->dx * cmd->dy);
+	}
+	return 0;
+}
 
-    // Invoke accelerator
+// starts one operation; the previous one has completed when this
+// returns (the IP was idle before the arguments were written)
+static void HwIpGfxaccel(GfxaccelInstance *inst, const GfxaccelCmd *cmd)
+{
+	GFXACCEL_STAT_ADD(&inst->stats, pixels, gfxaccel_cmd_pixels(cmd));
 #ifdef DEBUG
     printf("Wait for Idle signal...");
 #endif
     while (!gfxaccel_isidle(inst));
 #ifdef DEBUG
     printf("Done.\r\n\r\n");
+#endif
+
+	gfxaccel_set_src_fb(inst, cmd->src_fb);
+	gfxaccel_set_dst_fb(inst, cmd->dst_fb);
+	gfxaccel_set_mode(inst, cmd->mode); // mode
+	gfxaccel_set_op(inst, cmd->op); // op
+	gfxaccel_set_col(inst, cmd->col); // col
+	gfxaccel_set_x1(inst, cmd->x1); // x1
+	gfxaccel_set_y1(inst, cmd->y1); // y1
+	gfxaccel_set_dx(inst, cmd->dx); // dx
+	gfxaccel_set_dy(inst, cmd->dy); // dy
+	gfxaccel_set_x2(inst, cmd->x2); // x2
+	gfxaccel_set_y2(inst, cmd->y2); // y2
+	if (inst->backend == GFXACCEL_BACKEND_SOFT) {
+		gfxaccel_soft_run(inst, cmd);
+		return;
+	}
+
+    // Invoke accelerator
+#ifdef DEBUG
     printf("Send start Gfxaccel IP signal\r\n");
 #endif
     gfxaccel_start(inst);
@@ -202,19 +269,347 @@ static void HwIpGfxaccel(GfxaccelInstance *inst, u32 src_fb, u16 x1, u16 y1, u16
 #ifdef DEBUG
     printf("Done.\r\n\r\n");
 #endif
+	GFXACCEL_STAT_ADD(&inst->stats, cmds, 1);
+}
+
+static u64 gfxaccel_now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((u64)ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+}
+
+static void gfxaccel_run(GfxaccelInstance *inst, const GfxaccelCmd *cmd);
+
+// runs the commands of a list, then waits for the IP to measure it
+static void gfxaccel_run_list(GfxaccelInstance *inst, GfxaccelList *list)
+{
+	u64 t0 = gfxaccel_now_ns();
+	u32 ns;
+	int i;
+
+	for (i = 0; i < list->num; i++)
+		gfxaccel_run(inst, &list->cmds[i]);
+	while (!gfxaccel_isidle(inst));
+
+	ns = (u32)(gfxaccel_now_ns() - t0);
+	GFXACCEL_STAT_ADD(&list->stats, run_ns, ns);
+	if (ns > list->stats.run_ns_max)
+		__atomic_store_n(&list->stats.run_ns_max, ns, __ATOMIC_RELAXED);
+}
+
+static void gfxaccel_run(GfxaccelInstance *inst, const GfxaccelCmd *cmd)
+{
+	if (cmd->mode == GFXACCEL_MODE_LIST)
+		gfxaccel_run_list(inst, cmd->list);
+	else
+		HwIpGfxaccel(inst, cmd);
+}
+
+// feeds queued commands to the IP back to back. a command is done once
+// the IP is idle again, which is seen when the next one is started
+static void *gfxaccel_submit_thread(void *arg)
+{
+	GfxaccelInstance *inst = (GfxaccelInstance *)arg;
+	u32 tail = inst->tail;
+
+	while (1) {
+		sem_wait(&inst->work);
+		if (tail == __atomic_load_n(&inst->head, __ATOMIC_ACQUIRE)) {
+			if (__atomic_load_n(&inst->quit, __ATOMIC_ACQUIRE)) break;
+			continue;
+		}
+		gfxaccel_run(inst, &inst->queue[tail & (GFXACCEL_QUEUE_SIZE - 1)]);
+		__atomic_store_n(&inst->done, tail, __ATOMIC_RELEASE);
+		__atomic_store_n(&inst->tail, ++tail, __ATOMIC_RELEASE);
+
+		// nothing more to start: wait for the last one here
+		if (tail == __atomic_load_n(&inst->head, __ATOMIC_ACQUIRE)) {
+			while (!gfxaccel_isidle(inst));
+			__atomic_store_n(&inst->done, tail, __ATOMIC_RELEASE);
+		}
+	}
+	return 0;
+}
+
+// later gfxaccel calls on inst are queued until gfxaccel_stop_queue
+int gfxaccel_start_queue(GfxaccelInstance *inst)
+{
+	if (inst->running) return PST_SUCCESS;
+
+	inst->queue = (GfxaccelCmd *)malloc(GFXACCEL_QUEUE_SIZE * sizeof(GfxaccelCmd));
+	if (!inst->queue) {
+		printf("Error: Cannot allocate gfxaccel queue.\n");
+		return PST_FAILURE;
+	}
+	inst->head = inst->tail = inst->done = 0;
+	inst->quit = 0;
+	sem_init(&inst->work, 0, 0);
+	if (pthread_create(&inst->thread, NULL, &gfxaccel_submit_thread, inst)) {
+		printf("Error: gfxaccel submit thread cannot start.\n");
+		sem_destroy(&inst->work);
+		free(inst->queue);
+		inst->queue = 0;
+		return PST_FAILURE;
+	}
+	inst->running = 1;
+	return PST_SUCCESS;
+}
+
+// runs the queued commands to the end, then goes back to direct calls
+void gfxaccel_stop_queue(GfxaccelInstance *inst)
+{
+	if (!inst->running) return;
+
+	gfxaccel_finish(inst);
+	__atomic_store_n(&inst->quit, 1, __ATOMIC_RELEASE);
+	sem_post(&inst->work);
+	pthread_join(inst->thread, NULL);
+	sem_destroy(&inst->work);
+	free(inst->queue);
+	inst->queue = 0;
+	inst->running = 0;
+}
+
+// the IP takes coordinates in the frame buffer; a list checks them
+// once when it is recorded instead of at every replay
+static int gfxaccel_valid(const GfxaccelCmd *cmd)
+{
+	switch (cmd->mode) {
+	case GFXACCEL_MODE_FILLRECT:
+		return (cmd->x1 <= cmd->x2 && cmd->y1 <= cmd->y2 &&
+				cmd->x2 < DISP_WIDTH && cmd->y2 < DISP_HEIGHT);
+	case GFXACCEL_MODE_LINE:
+		return (cmd->x1 < DISP_WIDTH && cmd->y1 < DISP_HEIGHT &&
+				cmd->x2 < DISP_WIDTH && cmd->y2 < DISP_HEIGHT);
+	case GFXACCEL_MODE_BITBLT:
+		return (cmd->op <= GFXACCEL_BB_XOR && cmd->dx && cmd->dy &&
+				cmd->x1 + cmd->dx <= DISP_WIDTH && cmd->y1 + cmd->dy <= DISP_HEIGHT &&
+				cmd->x2 + cmd->dx <= DISP_WIDTH && cmd->y2 + cmd->dy <= DISP_HEIGHT);
+	case GFXACCEL_MODE_LIST:
+		return (cmd->list != 0);
+	}
+	return 0;
+}
+
+static void gfxaccel_list_add(GfxaccelList *list, const GfxaccelCmd *cmd)
+{
+	GfxaccelCmd *cmds;
+
+	if (!gfxaccel_valid(cmd)) {
+		printf("Error: gfxaccel mode %d (%d, %d)-(%d, %d) is not recorded.\n",
+			cmd->mode, cmd->x1, cmd->y1, cmd->x2, cmd->y2);
+		return;
+	}
+	if (list->num == list->size) {
+		cmds = (GfxaccelCmd *)realloc(list->cmds, (list->size + GFXACCEL_LIST_GROW) * sizeof(GfxaccelCmd));
+		if (!cmds) {
+			printf("Error: Cannot allocate gfxaccel list.\n");
+			return;
+		}
+		list->cmds = cmds;
+		list->size += GFXACCEL_LIST_GROW;
+	}
+	list->cmds[list->num++] = *cmd;
+}
+
+// adds the area a command draws on the tracked frame buffer
+static void gfxaccel_damage_cmd(DamageRegion *dmg, const GfxaccelCmd *cmd)
+{
+	int i;
+
+	switch (cmd->mode) {
+	case GFXACCEL_MODE_FILLRECT:
+		if (cmd->dst_fb == dmg->fb)
+			damage_add(dmg, cmd->x1, cmd->y1, cmd->x2, cmd->y2);
+		break;
+	case GFXACCEL_MODE_LINE:
+		if (cmd->dst_fb == dmg->fb) {
+			damage_add(dmg, (cmd->x1 < cmd->x2)? cmd->x1: cmd->x2, (cmd->y1 < cmd->y2)? cmd->y1: cmd->y2,
+				(cmd->x1 > cmd->x2)? cmd->x1: cmd->x2, (cmd->y1 > cmd->y2)? cmd->y1: cmd->y2);
+		}
+		break;
+	case GFXACCEL_MODE_BITBLT:
+		if (cmd->dst_fb == dmg->fb && cmd->dx && cmd->dy)
+			damage_add(dmg, cmd->x2, cmd->y2, cmd->x2 + cmd->dx - 1, cmd->y2 + cmd->dy - 1);
+		break;
+	case GFXACCEL_MODE_LIST:
+		for (i = 0; i < cmd->list->num; i++)
+			gfxaccel_damage_cmd(dmg, &cmd->list->cmds[i]);
+		break;
+	}
 }
 
+// returns at once unless the queue is full; without the queue the
+// command is started before this returns, as the direct calls do
+void gfxaccel_submit(GfxaccelInstance *inst, const GfxaccelCmd *cmd)
+{
+	u32 head;
+
+	if (inst->damage)
+		gfxaccel_damage_cmd(inst->damage, cmd);
+	if (inst->recording) {
+		gfxaccel_list_add(inst->recording, cmd);
+		return;
+	}
+	if (!inst->running) {
+		gfxaccel_run(inst, cmd);
+		return;
+	}
+
+	head = inst->head;
+	if (head - __atomic_load_n(&inst->tail, __ATOMIC_ACQUIRE) >= GFXACCEL_QUEUE_SIZE) {
+		GFXACCEL_STAT_ADD(&inst->stats, queue_full, 1);
+		while (head - __atomic_load_n(&inst->tail, __ATOMIC_ACQUIRE) >= GFXACCEL_QUEUE_SIZE)
+			usleep(GFXACCEL_POLL_US);
+	}
+	inst->queue[head & (GFXACCEL_QUEUE_SIZE - 1)] = *cmd;
+	__atomic_store_n(&inst->head, head + 1, __ATOMIC_RELEASE);
+	sem_post(&inst->work);
+}
+
+void gfxaccel_submit_fill_rect(GfxaccelInstance *inst, u32 fb, u16 x1, u16 y1, u16 x2, u16 y2, u32 col)
+{
+	GfxaccelCmd cmd = { 0, fb, col, x1, y1, 0, 0, x2, y2, GFXACCEL_MODE_FILLRECT, 0 };
+	gfxaccel_submit(inst, &cmd);
+}
+
+void gfxaccel_submit_draw_line(GfxaccelInstance *inst, u32 fb, u16 x1, u16 y1, u16 x2, u16 y2, u32 col)
+{
+	GfxaccelCmd cmd = { 0, fb, col, x1, y1, 0, 0, x2, y2, GFXACCEL_MODE_LINE, 0 };
+	gfxaccel_submit(inst, &cmd);
+}
+
+void gfxaccel_submit_bitblt(GfxaccelInstance *inst, u32 src_fb, u16 x1, u16 y1, u16 dx, u16 dy, u32 dst_fb, u16 x2, u16 y2, u8 op)
+{
+	GfxaccelCmd cmd = { src_fb, dst_fb, 0, x1, y1, dx, dy, x2, y2, GFXACCEL_MODE_BITBLT, op };
+	gfxaccel_submit(inst, &cmd);
+}
+
+// fence after the commands submitted so far
+GfxaccelFence gfxaccel_fence(GfxaccelInstance *inst)
+{
+	return (inst->head);
+}
+
+int gfxaccel_fence_done(GfxaccelInstance *inst, GfxaccelFence fence)
+{
+	if (!inst->running) return 1;
+	return ((int)(__atomic_load_n(&inst->done, __ATOMIC_ACQUIRE) - fence) >= 0);
+}
+
+void gfxaccel_wait_fence(GfxaccelInstance *inst, GfxaccelFence fence)
+{
+	u64 t0;
+
+	if (gfxaccel_fence_done(inst, fence)) return;
+	t0 = gfxaccel_now_ns();
+	while (!gfxaccel_fence_done(inst, fence))
+		usleep(GFXACCEL_POLL_US);
+	GFXACCEL_STAT_ADD(&inst->stats, fence_wait_ns, gfxaccel_now_ns() - t0);
+}
+
+void gfxaccel_finish(GfxaccelInstance *inst)
+{
+	gfxaccel_wait_fence(inst, gfxaccel_fence(inst));
+}
+
+// the area of the following gfxaccel calls on dmg->fb is added to dmg
+// until this is called with NULL
+void gfxaccel_track_damage(GfxaccelInstance *inst, DamageRegion *dmg)
+{
+	inst->damage = dmg;
+}
+
+// cmds is counted by the submitter, so it may lag by one command.
+// each field is read whole, the snapshot is not consistent between them
+void gfxaccel_get_stats(GfxaccelInstance *inst, GfxaccelStats *stats)
+{
+	GfxaccelStats *st = &inst->stats;
+
+	stats->cmds          = GFXACCEL_STAT_GET(st, cmds);
+	stats->queue_full    = GFXACCEL_STAT_GET(st, queue_full);
+	stats->fence_wait_ns = GFXACCEL_STAT_GET(st, fence_wait_ns);
+	stats->reg_writes    = GFXACCEL_STAT_GET(st, reg_writes);
+	stats->reg_elided    = GFXACCEL_STAT_GET(st, reg_elided);
+	stats->pixels        = GFXACCEL_STAT_GET(st, pixels);
+}
+
+// with the queue running the direct calls wait for everything queued
+// before them, so callers that do not use fences keep their order
 void gfxaccel_fill_rect(GfxaccelInstance *inst, u32 fb, u16 x1, u16 y1, u16 x2, u16 y2, u32 col)
 {
-	HwIpGfxaccel(inst, 0, x1, y1, 0, 0, fb, x2, y2, col, GFXACCEL_MODE_FILLRECT, 0);
+	gfxaccel_submit_fill_rect(inst, fb, x1, y1, x2, y2, col);
+	gfxaccel_finish(inst);
 }
 
 void gfxaccel_draw_line(GfxaccelInstance *inst, u32 fb, u16 x1, u16 y1, u16 x2, u16 y2, u32 col)
 {
-	HwIpGfxaccel(inst, 0, x1, y1, 0, 0, fb, x2, y2, col, GFXACCEL_MODE_LINE, 0);
+	gfxaccel_submit_draw_line(inst, fb, x1, y1, x2, y2, col);
+	gfxaccel_finish(inst);
 }
 
 void gfxaccel_bitblt(GfxaccelInstance *inst, u32 src_fb, u16 x1, u16 y1, u16 dx, u16 dy, u32 dst_fb, u16 x2, u16 y2, u8 op)
 {
-	HwIpGfxaccel(inst, src_fb, x1, y1, dx, dy, dst_fb, x2, y2, 0, GFXACCEL_MODE_BITBLT, op);
+	gfxaccel_submit_bitblt(inst, src_fb, x1, y1, dx, dy, dst_fb, x2, y2, op);
+	gfxaccel_finish(inst);
+}
+
+void gfxaccel_list_init(GfxaccelList *list)
+{
+	memset(list, 0, sizeof(*list));
+}
+
+// the list may still be queued; these wait for its last replay
+void gfxaccel_list_free(GfxaccelInstance *inst, GfxaccelList *list)
+{
+	gfxaccel_wait_fence(inst, list->fence);
+	free(list->cmds);
+	gfxaccel_list_init(list);
+}
+
+void gfxaccel_list_reset(GfxaccelInstance *inst, GfxaccelList *list)
+{
+	gfxaccel_wait_fence(inst, list->fence);
+	list->num = 0;
+}
+
+// the following gfxaccel calls on inst are added to list instead of run
+void gfxaccel_list_begin(GfxaccelInstance *inst, GfxaccelList *list)
+{
+	gfxaccel_list_reset(inst, list);
+	inst->recording = list;
+}
+
+void gfxaccel_list_end(GfxaccelInstance *inst)
+{
+	inst->recording = 0;
+}
+
+// one queue entry however long the list is; the list must not change
+// until its fence is done
+void gfxaccel_list_replay(GfxaccelInstance *inst, GfxaccelList *list)
+{
+	GfxaccelCmd cmd;
+	u64 t0 = gfxaccel_now_ns();
+
+	if (!list->num) return;
+	memset(&cmd, 0, sizeof(cmd));
+	cmd.mode = GFXACCEL_MODE_LIST;
+	cmd.list = list;
+	gfxaccel_submit(inst, &cmd);
+	list->fence = gfxaccel_fence(inst);
+	GFXACCEL_STAT_ADD(&list->stats, replays, 1);
+	GFXACCEL_STAT_ADD(&list->stats, submit_ns, gfxaccel_now_ns() - t0);
+}
+
+// run_ns is updated by the submitter, so it may lag by one replay
+void gfxaccel_list_get_stats(GfxaccelList *list, GfxaccelListStats *stats)
+{
+	GfxaccelListStats *st = &list->stats;
+
+	stats->replays    = GFXACCEL_STAT_GET(st, replays);
+	stats->submit_ns  = GFXACCEL_STAT_GET(st, submit_ns);
+	stats->run_ns     = GFXACCEL_STAT_GET(st, run_ns);
+	stats->run_ns_max = GFXACCEL_STAT_GET(st, run_ns_max);
 }
@@ -0,0 +1,185 @@
+/******************************************************
+ *    Filename:     gfxaccel_soft.c
+ *     Purpose:     graphics accelerator in software
+ *  Target Plf:     Linux host / ZYBO (azplf)
+ *  Created on: 	2026/10/17
+ * Modified on:
+ *      Author: 	atsupi.com
+ *     Version:		0.90
+ ******************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "azplf_bsp.h"
+#include "gfxaccel.h"
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define GFXACCEL_NEON
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define GFXACCEL_SSE2
+#endif
+
+#define FB_PIXELS				(DISP_WIDTH * DISP_HEIGHT)
+
+// host memory standing in for the physical range from baseAddress
+u32 gfxaccel_init_soft(GfxaccelInstance *inst, u32 baseAddr, u32 size)
+{
+	memset(inst, 0, sizeof(*inst));
+	inst->baseAddress = baseAddr;
+	inst->backend = GFXACCEL_BACKEND_SOFT;
+	inst->soft_size = size;
+	inst->soft_mem = (u32 *)calloc(size / 4, 4);
+	if (!inst->soft_mem) {
+		printf("Error: Cannot allocate %u bytes for gfxaccel.\n", size);
+		return PST_FAILURE;
+	}
+	printf("gfxaccel runs in software (0x%08x - 0x%08x).\n", baseAddr, baseAddr + size - 1);
+	return PST_SUCCESS;
+}
+
+// host address of a frame buffer, NULL unless it lies in the memory
+u32 *gfxaccel_get_fb(GfxaccelInstance *inst, u32 fb)
+{
+	if (inst->backend != GFXACCEL_BACKEND_SOFT) return 0;
+	if (fb < inst->baseAddress || (fb - inst->baseAddress) & 3 ||
+		fb - inst->baseAddress + FB_PIXELS * 4 > inst->soft_size)
+		return 0;
+	return (inst->soft_mem + (fb - inst->baseAddress) / 4);
+}
+
+static void fill_row(u32 *dst, u32 col, int n)
+{
+	int i = 0;
+#if defined(GFXACCEL_NEON)
+	uint32x4_t c = vdupq_n_u32(col);
+
+	for (; i + 8 <= n; i += 8) {
+		vst1q_u32(&dst[i], c);
+		vst1q_u32(&dst[i + 4], c);
+	}
+#elif defined(GFXACCEL_SSE2)
+	__m128i c = _mm_set1_epi32((int)col);
+
+	for (; i + 8 <= n; i += 8) {
+		_mm_storeu_si128((__m128i *)&dst[i], c);
+		_mm_storeu_si128((__m128i *)&dst[i + 4], c);
+	}
+#endif
+	for (; i < n; i++)
+		dst[i] = col;
+}
+
+static void blit_row(u32 *dst, const u32 *src, int n, int op)
+{
+	int i = 0;
+#if defined(GFXACCEL_NEON)
+	uint32x4_t s, d;
+
+	for (; i + 4 <= n; i += 4) {
+		s = vld1q_u32(&src[i]);
+		if (op != GFXACCEL_BB_NONE) {
+			d = vld1q_u32(&dst[i]);
+			if (op == GFXACCEL_BB_OR)       s = vorrq_u32(d, s);
+			else if (op == GFXACCEL_BB_AND) s = vandq_u32(d, s);
+			else                            s = veorq_u32(d, s);
+		}
+		vst1q_u32(&dst[i], s);
+	}
+#elif defined(GFXACCEL_SSE2)
+	__m128i s, d;
+
+	for (; i + 4 <= n; i += 4) {
+		s = _mm_loadu_si128((const __m128i *)&src[i]);
+		if (op != GFXACCEL_BB_NONE) {
+			d = _mm_loadu_si128((const __m128i *)&dst[i]);
+			if (op == GFXACCEL_BB_OR)       s = _mm_or_si128(d, s);
+			else if (op == GFXACCEL_BB_AND) s = _mm_and_si128(d, s);
+			else                            s = _mm_xor_si128(d, s);
+		}
+		_mm_storeu_si128((__m128i *)&dst[i], s);
+	}
+#endif
+	for (; i < n; i++) {
+		switch (op) {
+		case GFXACCEL_BB_OR:  dst[i] |= src[i]; break;
+		case GFXACCEL_BB_AND: dst[i] &= src[i]; break;
+		case GFXACCEL_BB_XOR: dst[i] ^= src[i]; break;
+		default:              dst[i]  = src[i]; break;
+		}
+	}
+}
+
+// corners are inclusive, as for the IP
+static void soft_fill_rect(u32 *fb, int x1, int y1, int x2, int y2, u32 col)
+{
+	int y;
+
+	if (x2 >= DISP_WIDTH)  x2 = DISP_WIDTH - 1;
+	if (y2 >= DISP_HEIGHT) y2 = DISP_HEIGHT - 1;
+	if (x1 > x2 || y1 > y2) return;
+	for (y = y1; y <= y2; y++)
+		fill_row(&fb[y * DISP_WIDTH + x1], col, x2 - x1 + 1);
+}
+
+// Bresenham, both end points drawn
+static void soft_draw_line(u32 *fb, int x1, int y1, int x2, int y2, u32 col)
+{
+	int dx = (x2 > x1)? x2 - x1: x1 - x2;
+	int dy = (y2 > y1)? y1 - y2: y2 - y1;
+	int sx = (x2 > x1)? 1: -1;
+	int sy = (y2 > y1)? 1: -1;
+	int err = dx + dy, e2;
+
+	while (1) {
+		if (x1 < DISP_WIDTH && y1 < DISP_HEIGHT)
+			fb[y1 * DISP_WIDTH + x1] = col;
+		if (x1 == x2 && y1 == y2) break;
+		e2 = 2 * err;
+		if (e2 >= dy) { err += dy; x1 += sx; }
+		if (e2 <= dx) { err += dx; y1 += sy; }
+	}
+}
+
+static void soft_bitblt(const u32 *src, int x1, int y1, int dx, int dy, u32 *dst, int x2, int y2, int op)
+{
+	int y;
+
+	if (x1 + dx > DISP_WIDTH)  dx = DISP_WIDTH - x1;
+	if (x2 + dx > DISP_WIDTH)  dx = DISP_WIDTH - x2;
+	if (y1 + dy > DISP_HEIGHT) dy = DISP_HEIGHT - y1;
+	if (y2 + dy > DISP_HEIGHT) dy = DISP_HEIGHT - y2;
+	for (y = 0; y < dy; y++)
+		blit_row(&dst[(y2 + y) * DISP_WIDTH + x2], &src[(y1 + y) * DISP_WIDTH + x1], dx, op);
+}
+
+// runs one operation before returning; the instance is always idle
+void gfxaccel_soft_run(GfxaccelInstance *inst, const GfxaccelCmd *cmd)
+{
+	u32 *dst = gfxaccel_get_fb(inst, cmd->dst_fb);
+	u32 *src;
+
+	if (!dst) {
+		printf("Error: gfxaccel frame buffer 0x%08x is out of memory.\n", cmd->dst_fb);
+		return;
+	}
+	switch (cmd->mode) {
+	case GFXACCEL_MODE_FILLRECT:
+		soft_fill_rect(dst, cmd->x1, cmd->y1, cmd->x2, cmd->y2, cmd->col);
+		break;
+	case GFXACCEL_MODE_LINE:
+		soft_draw_line(dst, cmd->x1, cmd->y1, cmd->x2, cmd->y2, cmd->col);
+		break;
+	case GFXACCEL_MODE_BITBLT:
+		src = gfxaccel_get_fb(inst, cmd->src_fb);
+		if (!src) {
+			printf("Error: gfxaccel frame buffer 0x%08x is out of memory.\n", cmd->src_fb);
+			return;
+		}
+		soft_bitblt(src, cmd->x1, cmd->y1, cmd->dx, cmd->dy, dst, cmd->x2, cmd->y2, cmd->op);
+		break;
+	}
+	GFXACCEL_STAT_ADD(&inst->stats, cmds, 1);
+}
@@ -0,0 +1,81 @@
+/******************************************************
+ *    Filename:     ima_adpcm.c
+ *     Purpose:     IMA-ADPCM (WAV format 0x11) decoder
+ *  Target Plf:     ZYBO (azplf)
+ *  Created on: 	2026/10/17
+ * Modified on:
+ *      Author: 	atsupi.com
+ *     Version:		0.90
+ ******************************************************/
+
+#include <stdio.h>
+#include "azplf_bsp.h"
+#include "ima_adpcm.h"
+
+static const signed char index_tbl[8] = { -1, -1, -1, -1, 2, 4, 6, 8 };
+
+static const short step_tbl[89] = {
+	    7,     8,     9,    10,    11,    12,    13,    14,    16,    17,
+	   19,    21,    23,    25,    28,    31,    34,    37,    41,    45,
+	   50,    55,    60,    66,    73,    80,    88,    97,   107,   118,
+	  130,   143,   157,   173,   190,   209,   230,   253,   279,   307,
+	  337,   371,   408,   449,   494,   544,   598,   658,   724,   796,
+	  876,   963,  1060,  1166,  1282,  1411,  1552,  1707,  1878,  2066,
+	 2272,  2499,  2749,  3024,  3327,  3660,  4026,  4428,  4871,  5358,
+	 5894,  6484,  7132,  7845,  8630,  9493, 10442, 11487, 12635, 13899,
+	15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+
+// one nibble; predictor and index stay in registers across a block
+#define IMA_NIBBLE(code) { \
+	int step = step_tbl[index]; \
+	int diff = step >> 3; \
+	if ((code) & 1) diff += step >> 2; \
+	if ((code) & 2) diff += step >> 1; \
+	if ((code) & 4) diff += step; \
+	pred += ((code) & 8)? -diff: diff; \
+	if (pred >  32767) pred =  32767; \
+	if (pred < -32768) pred = -32768; \
+	index += index_tbl[(code) & 7]; \
+	if (index < 0)  index = 0; \
+	if (index > 88) index = 88; \
+	*out = (short)pred; \
+	out += step_out; \
+}
+
+int ima_decode_channel(const u8 *block, int block_bytes, int nch, int ch, short *out, int step_out)
+{
+	const u8 *p;
+	int pred, index;
+	int groups, g, k;
+
+	if (block_bytes < 4 * nch) return 0;
+
+	// header: predictor (s16), step index, reserved
+	p = &block[ch * 4];
+	pred  = (short)(p[0] | (p[1] << 8));
+	index = p[2];
+	if (index > 88) index = 88;
+	*out = (short)pred;
+	out += step_out;
+
+	// 4 bytes (8 samples) per channel in turn, low nibble first
+	groups = (block_bytes - 4 * nch) / (4 * nch);
+	p = &block[4 * nch + 4 * ch];
+	for (g = 0; g < groups; g++, p += 4 * nch) {
+		for (k = 0; k < 4; k++) {
+			IMA_NIBBLE(p[k] & 0xF);
+			IMA_NIBBLE(p[k] >> 4);
+		}
+	}
+	return (groups * 8 + 1);
+}
+
+int ima_decode_block(const u8 *block, int block_bytes, int nch, short *out)
+{
+	int ch, n = 0;
+
+	for (ch = 0; ch < nch; ch++)
+		n = ima_decode_channel(block, block_bytes, nch, ch, &out[ch], nch);
+	return (n);
+}
@@ -0,0 +1,234 @@
+/******************************************************
+ *    Filename:     pcm_convert.c
+ *     Purpose:     PCM sample format converters
+ *  Target Plf:     ZYBO (azplf)
+ *  Created on: 	2026/10/17
+ * Modified on:
+ *      Author: 	atsupi.com
+ *     Version:		0.90
+ ******************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include "azplf_bsp.h"
+#include "pcm_convert.h"
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define PCM_NEON
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define PCM_SSE2
+#endif
+
+// the vector loops leave the tail (i < n) to the scalar code
+
+void pcm_u8_to_s16(const u8 *in, short *out, int n)
+{
+	int i = 0;
+
+#if defined(PCM_NEON)
+	for (; i + 16 <= n; i += 16) {
+		uint8x16_t s = veorq_u8(vld1q_u8(&in[i]), vdupq_n_u8(0x80));
+		vst1q_s16(&out[i],     vreinterpretq_s16_u16(vshll_n_u8(vget_low_u8(s),  8)));
+		vst1q_s16(&out[i + 8], vreinterpretq_s16_u16(vshll_n_u8(vget_high_u8(s), 8)));
+	}
+#elif defined(PCM_SSE2)
+	for (; i + 16 <= n; i += 16) {
+		__m128i s = _mm_xor_si128(_mm_loadu_si128((const __m128i *)&in[i]), _mm_set1_epi8((char)0x80));
+		_mm_storeu_si128((__m128i *)&out[i],     _mm_unpacklo_epi8(_mm_setzero_si128(), s));
+		_mm_storeu_si128((__m128i *)&out[i + 8], _mm_unpackhi_epi8(_mm_setzero_si128(), s));
+	}
+#endif
+	for (; i < n; i++)
+		out[i] = (short)((in[i] - 128) << 8);
+}
+
+void pcm_s24_to_s16(const u8 *in, short *out, int n)
+{
+	int i = 0;
+
+#if defined(PCM_NEON)
+	// the upper two bytes of each sample are the 16bit sample
+	for (; i + 16 <= n; i += 16) {
+		uint8x16x3_t s = vld3q_u8(&in[i * 3]);
+		uint8x16x2_t d;
+		d.val[0] = s.val[1];
+		d.val[1] = s.val[2];
+		vst2q_u8((u8 *)&out[i], d);
+	}
+#endif
+	for (; i < n; i++)
+		out[i] = (short)(in[i * 3 + 1] | (in[i * 3 + 2] << 8));
+}
+
+void pcm_s32_to_s16(const int32_t *in, short *out, int n)
+{
+	int i = 0;
+
+#if defined(PCM_NEON)
+	for (; i + 8 <= n; i += 8) {
+		vst1q_s16(&out[i], vcombine_s16(vshrn_n_s32(vld1q_s32(&in[i]), 16),
+										vshrn_n_s32(vld1q_s32(&in[i + 4]), 16)));
+	}
+#elif defined(PCM_SSE2)
+	for (; i + 8 <= n; i += 8) {
+		__m128i a = _mm_srai_epi32(_mm_loadu_si128((const __m128i *)&in[i]), 16);
+		__m128i b = _mm_srai_epi32(_mm_loadu_si128((const __m128i *)&in[i + 4]), 16);
+		_mm_storeu_si128((__m128i *)&out[i], _mm_packs_epi32(a, b));
+	}
+#endif
+	for (; i < n; i++)
+		out[i] = (short)(in[i] >> 16);
+}
+
+void pcm_f32_to_s16(const float *in, short *out, int n)
+{
+	float x;
+	int i = 0;
+
+	// scaled, clamped and truncated toward zero on every path
+#if defined(PCM_NEON)
+	float32x4_t scale = vdupq_n_f32(32768.0f);
+	float32x4_t hi = vdupq_n_f32(32767.0f), lo = vdupq_n_f32(-32768.0f);
+	for (; i + 8 <= n; i += 8) {
+		float32x4_t a = vmaxq_f32(vminq_f32(vmulq_f32(vld1q_f32(&in[i]),     scale), hi), lo);
+		float32x4_t b = vmaxq_f32(vminq_f32(vmulq_f32(vld1q_f32(&in[i + 4]), scale), hi), lo);
+		vst1q_s16(&out[i], vcombine_s16(vmovn_s32(vcvtq_s32_f32(a)), vmovn_s32(vcvtq_s32_f32(b))));
+	}
+#elif defined(PCM_SSE2)
+	__m128 scale = _mm_set1_ps(32768.0f);
+	__m128 hi = _mm_set1_ps(32767.0f), lo = _mm_set1_ps(-32768.0f);
+	for (; i + 8 <= n; i += 8) {
+		__m128 a = _mm_max_ps(_mm_min_ps(_mm_mul_ps(_mm_loadu_ps(&in[i]),     scale), hi), lo);
+		__m128 b = _mm_max_ps(_mm_min_ps(_mm_mul_ps(_mm_loadu_ps(&in[i + 4]), scale), hi), lo);
+		_mm_storeu_si128((__m128i *)&out[i], _mm_packs_epi32(_mm_cvttps_epi32(a), _mm_cvttps_epi32(b)));
+	}
+#endif
+	for (; i < n; i++) {
+		x = in[i] * 32768.0f;
+		if (x >  32767.0f) x =  32767.0f;
+		if (x < -32768.0f) x = -32768.0f;
+		out[i] = (short)x;
+	}
+}
+
+void pcm_mono_to_stereo(const short *in, short *out, int n)
+{
+	int i = 0;
+
+#if defined(PCM_NEON)
+	for (; i + 8 <= n; i += 8) {
+		int16x8x2_t d;
+		d.val[0] = d.val[1] = vld1q_s16(&in[i]);
+		vst2q_s16(&out[i * 2], d);
+	}
+#elif defined(PCM_SSE2)
+	for (; i + 8 <= n; i += 8) {
+		__m128i s = _mm_loadu_si128((const __m128i *)&in[i]);
+		_mm_storeu_si128((__m128i *)&out[i * 2],     _mm_unpacklo_epi16(s, s));
+		_mm_storeu_si128((__m128i *)&out[i * 2 + 8], _mm_unpackhi_epi16(s, s));
+	}
+#endif
+	for (; i < n; i++)
+		out[i * 2] = out[i * 2 + 1] = in[i];
+}
+
+void pcm_stereo_to_mono(const short *in, short *out, int n)
+{
+	int i = 0;
+
+	// (l + r) / 2 rounded toward minus infinity
+#if defined(PCM_NEON)
+	for (; i + 8 <= n; i += 8) {
+		int16x8x2_t s = vld2q_s16(&in[i * 2]);
+		vst1q_s16(&out[i], vhaddq_s16(s.val[0], s.val[1]));
+	}
+#elif defined(PCM_SSE2)
+	for (; i + 8 <= n; i += 8) {
+		__m128i a = _mm_loadu_si128((const __m128i *)&in[i * 2]);
+		__m128i b = _mm_loadu_si128((const __m128i *)&in[i * 2 + 8]);
+		// l + r of each frame with madd, then halve
+		__m128i one = _mm_set1_epi16(1);
+		__m128i sa = _mm_srai_epi32(_mm_madd_epi16(a, one), 1);
+		__m128i sb = _mm_srai_epi32(_mm_madd_epi16(b, one), 1);
+		_mm_storeu_si128((__m128i *)&out[i], _mm_packs_epi32(sa, sb));
+	}
+#endif
+	for (; i < n; i++)
+		out[i] = (short)((in[i * 2] + in[i * 2 + 1]) >> 1);
+}
+
+// first two of nch interleaved channels into planar left and right
+void pcm_deinterleave(const short *in, int nch, short *l, short *r, int n)
+{
+	int i = 0;
+
+	if (nch == 1) {
+		memcpy(l, in, n * sizeof(short));
+		memcpy(r, in, n * sizeof(short));
+		return;
+	}
+#if defined(PCM_NEON)
+	if (nch == 2) {
+		for (; i + 8 <= n; i += 8) {
+			int16x8x2_t s = vld2q_s16(&in[i * 2]);
+			vst1q_s16(&l[i], s.val[0]);
+			vst1q_s16(&r[i], s.val[1]);
+		}
+	}
+#elif defined(PCM_SSE2)
+	if (nch == 2) {
+		for (; i + 8 <= n; i += 8) {
+			__m128i a = _mm_loadu_si128((const __m128i *)&in[i * 2]);
+			__m128i b = _mm_loadu_si128((const __m128i *)&in[i * 2 + 8]);
+			// sign-extended low halves are left, high halves are right
+			_mm_storeu_si128((__m128i *)&l[i], _mm_packs_epi32(
+				_mm_srai_epi32(_mm_slli_epi32(a, 16), 16), _mm_srai_epi32(_mm_slli_epi32(b, 16), 16)));
+			_mm_storeu_si128((__m128i *)&r[i], _mm_packs_epi32(
+				_mm_srai_epi32(a, 16), _mm_srai_epi32(b, 16)));
+		}
+	}
+#endif
+	for (; i < n; i++) {
+		l[i] = in[i * nch];
+		r[i] = in[i * nch + 1];
+	}
+}
+
+int pcm_supported(int format, int bits)
+{
+	if (format == PCM_FORMAT_PCM)
+		return (bits == 8 || bits == 16 || bits == 24 || bits == 32);
+	if (format == PCM_FORMAT_FLOAT)
+		return (bits == 32);
+	return 0;
+}
+
+int pcm_to_s16(const void *in, int format, int bits, short *out, int n)
+{
+	if (format == PCM_FORMAT_FLOAT && bits == 32) {
+		pcm_f32_to_s16((const float *)in, out, n);
+		return (PST_SUCCESS);
+	}
+	if (format != PCM_FORMAT_PCM)
+		return (PST_FAILURE);
+
+	switch (bits) {
+	case 8:
+		pcm_u8_to_s16((const u8 *)in, out, n);
+		break;
+	case 16:
+		if (out != in) memmove(out, in, n * sizeof(short));
+		break;
+	case 24:
+		pcm_s24_to_s16((const u8 *)in, out, n);
+		break;
+	case 32:
+		pcm_s32_to_s16((const int32_t *)in, out, n);
+		break;
+	default:
+		return (PST_FAILURE);
+	}
+	return (PST_SUCCESS);
+}
@@ -18,22 +18,94 @@
 #include <stdint.h>
 #include <fcntl.h>
 #include <math.h>
+#include <time.h>
 #include <sys/mman.h>
 #include "psg_util.h"
+#include "psg_osc.h"
 
-#define PSG_FRAME_SIZE			1200
 #define VAL_NO_TONE			0x7FFFFFFF
 #define TBL_tone_no			8
 #define FIRST_TBL_TONE		3
+#define NUM_KEYS			84		// 7 octaves
+
+// compiled MML commands
+#define EV_NOTE				0		// value: key number (0~83)
+#define EV_REST				1
+#define EV_TONE_RATE		2		// q
+#define EV_VOLUME			3		// v
+#define EV_PWM_RATE			4		// x
+#define EV_ENVELOPE			5		// s
+#define EV_ENV_LEN			6		// m
+#define EV_TONE				7		// @
+#define EV_PITCH			8		// p
+#define EV_TUNE_DEPTH		9		// h
+#define EV_LOOP_BEGIN		10		// [ value: count
+#define EV_LOOP_END			11		// ] len: events back to the loop top
+#define EV_CALL				12		// $ value: pattern number
+
+#define EVF_TIE				0x01	// bond with the previous key (&)
+
+// o, <, >, t and l only change the compile state, so a note/rest
+// event already carries its key number and length in samples.
+typedef struct _PsgEvent {
+	u8  cmd;
+	u8  flags;
+	u16 value;
+	u32 len;
+} PsgEvent;
+
+// compiled MML of a sound effect
+typedef struct _PsgSeq {
+	PsgEvent *events;
+	int num_events;
+} PsgSeq;
+
+// compile state; o, <, >, t, l and & only change this
+typedef struct _MmlState {
+	int tempo;
+	int keylen;
+	int octave;
+	int def_len;
+	int tie;
+} MmlState;
+
+// event list being compiled
+typedef struct _MmlList {
+	PsgEvent *events;
+	int num;
+	int size;
+	int length;		// frames of one pass
+	int num_keys;
+	int nest;		// deepest loop or macro call level reached
+	int failed;
+} MmlList;
+
+// macro compiled for one compile state, shared by every caller
+typedef struct _PsgPattern {
+	int macro;		// -1 after the macro is redefined
+	MmlState in;	// state at the call
+	MmlState out;	// state after the pattern
+	PsgEvent *events;
+	int num_events;
+	int length;
+	int num_keys;
+	int nest;		// levels a call takes, the call itself included
+} PsgPattern;
+
+// return point of a macro call
+typedef struct _PsgCall {
+	const PsgEvent *events;
+	int num_events;
+	int ev_pos;
+} PsgCall;
 
 typedef struct _Ch_Data {
-	char mml[MAX_MML_LEN];
 	int fr_value;
 	int fr_tune;
-	int mml_pos;
+	int ev_pos;
 	int slice_pos;
 	int frame_pos;
-	int fr_counter;
+	int gate_len;
 	int len;
 	int def_len;
 	int def_keylen;
@@ -48,121 +120,103 @@ typedef struct _Ch_Data {
 	int tone_no;
 	int pitch_no;
 	int tune_depth;
-	int tie;
+	PsgOsc osc;
+	const PsgEvent *events;
+	int num_events;
+	int active;
+	int owner;		// music track number, -1 for sound effect
+	int priority;
+	int pan;
+	u32 age;		// allocation order for stealing
+	int loop_depth;
+	int loop_cnt[PSG_NEST_MAX];
+	int call_depth;
+	PsgCall calls[PSG_NEST_MAX];
 } Ch_Data;
 
 static int  skip_frame = 0;
-static u32  pcm[CH_NUM][PSG_FRAME_SIZE];
+static short pcm[PSG_VOICE_NUM][PSG_FRAME_SIZE];
+static u32  out[PSG_FRAME_SIZE];
+static int  out_pos = PSG_FRAME_SIZE;	// frames of out already played
 static char tone_tbl[TBL_tone_no][256];
-static int  init_tonetbl = 0;
+static u32  period_tbl[NUM_KEYS];
+static int  init_psg = 0;
 
-// volume curve table
-static float vol_curve[] = {
-	 0,  1,   4,   9,  16,  25,  36,  49,  64, 81, 100, 121, 144, 169, 204, 256.0
+// default MML for each channel
+// please put "r" in every channel if no note is attached.
+static char *default_mml[CH_NUM] = {
+	"r16",
+	"t120l8v8x25q6r16",
+	"t60l4v15x12@4o1cego2cego3cego4cego5cego6cego7cegr2.",
+	"t60r", // no play
 };
 
-// channel data table
-// please put "r" in every channel if no note is attached. 
-static Ch_Data psg[CH_NUM] = {
-	{
-		"r16",
-		0,		// fr_value(c~b)
-		0,		// fr_tune
-		0,		// mml_pos
-		0,		// slice_pos
-		0,		// frame_pos,
-		0,		// fr_counter
-		0,		// len
-		30*800,	// def_len: T120L4 = 30*800[1/60sec]
-		4,		// def_keylen(l)
-		120,	// tempo(t)
-		4,		// octave(o)
-		15,		// local_vol(v) (0~15)
-		15,		// int_vol
-		8,		// tone_rate(q) (1~8)
-		50,		// pwm_rate(x) (1~99)
-		0,		// env_no(s) (0:flat 1~3)
-		1,		// env_len(m)
-		0,		// tone_no(@) (0:none 1)
-		0,		// pitch_no(p)
-		0,		// tune_depth(h) (0~255)
-		0,		// tie
-	},
-	{
-		"t120l8v8x25q6r16",
-		0,		// fr_value(c~b)
-		0,		// fr_tune
-		0,		// mml_pos
-		0,		// slice_pos
-		0,		// frame_pos,
-		0,		// fr_counter
-		0,		// len
-		30*800,	// def_len: T120L4 = 30*800[1/60sec]
-		4,		// def_keylen(l)
-		120,	// tempo(t)
-		4,		// octave(o)
-		15,		// local_vol(v) (0~15)
-		15,		// int_vol
-		8,		// tone_rate(q) (1~8)
-		50,		// pwm_rate(x) (1~99)
-		0,		// env_no(s) (0:flat 1~3)
-		1,		// env_len(m)
-		0,		// tone_no(@) (0:none 1)
-		0,		// pitch_no(p)
-		0,		// tune_depth(h) (0~255)
-		0,		// tie
-	},
-	{
-		"t60l4v15x12@4o1cego2cego3cego4cego5cego6cego7cegr2.", //mml
-		0,		// fr_value(c~b)
-		0,		// fr_tune
-		0,		// mml_pos
-		0,		// slice_pos
-		0,		// frame_pos,
-		0,		// fr_counter
-		0,		// len
-		30*800,	// def_len: T120L4 = 30*800[1/60sec]
-		4,		// def_keylen(l)
-		120,	// tempo(t)
-		4,		// octave(o)
-		15,		// local_vol(v) (0~15)
-		15,		// int_vol
-		8,		// tone_rate(q) (1~8)
-		50,		// pwm_rate(x) (1~99)
-		0,		// env_no(s) (0:flat 1~3)
-		1,		// env_len(m)
-		0,		// tone_no(@) (0:none 1)
-		0,		// pitch_no(p)
-		0,		// tune_depth(h) (0~255)
-		0,		// tie
-	},
-	{
-		// no play
-		"t60r", //mml
-		0,		// fr_value(c~b)
-		0,		// fr_tune
-		0,		// mml_pos
-		0,		// slice_pos
-		0,		// frame_pos,
-		0,		// fr_counter
-		0,		// len
-		30*800,	// def_len: T120L4 = 30*800[1/60sec]
-		4,		// def_keylen(l)
-		120,	// tempo(t)
-		4,		// octave(o)
-		15,		// local_vol(v) (0~15)
-		15,		// int_vol
-		8,		// tone_rate(q) (1~8)
-		50,		// pwm_rate(x) (1~99)
-		0,		// env_no(s) (0:flat 1~3)
-		1,		// env_len(m)
-		0,		// tone_no(@) (0:none 1)
-		0,		// pitch_no(p)
-		0,		// tune_depth(h) (0~255)
-		0,		// tie
-	},
+// initial state of a voice
+static const Ch_Data voice_template = {
+	0,		// fr_value(c~b) Q16 period
+	0,		// fr_tune
+	0,		// ev_pos
+	0,		// slice_pos
+	0,		// frame_pos,
+	0,		// gate_len
+	0,		// len
+	30*800,	// def_len: T120L4 = 30*800[1/60sec]
+	4,		// def_keylen(l)
+	120,	// tempo(t)
+	4,		// octave(o)
+	15,		// local_vol(v) (0~15)
+	15,		// int_vol
+	8,		// tone_rate(q) (1~8)
+	50,		// pwm_rate(x) (1~99)
+	0,		// env_no(s) (0:flat 1~3)
+	1,		// env_len(m)
+	0,		// tone_no(@) (0:none 1)
+	0,		// pitch_no(p)
+	0,		// tune_depth(h) (0~255)
 };
 
+// voice pool shared by music tracks and sound effects
+static Ch_Data voice[PSG_VOICE_NUM];
+static u32  voice_age = 0;
+static u32  voice_gen[PSG_VOICE_NUM];	// bumped each time a voice is handed out
+
+// sound effect handle: generation above the voice number, so a handle
+// kept after its voice was reused matches nothing
+#define VOICE_HANDLE(v)		((int)((voice_gen[v] & 0x7fffff) << 8 | (v)))
+#define HANDLE_VOICE(h)		((h) & 0xff)
+#if PSG_VOICE_NUM > 256
+#error "PSG_VOICE_NUM does not fit in a sound effect handle"
+#endif
+#if PSG_MIX_HEADROOM < CH_NUM || PSG_MIX_HEADROOM > MIXER_GAIN_UNITY
+#error "PSG_MIX_HEADROOM must be CH_NUM~MIXER_GAIN_UNITY"
+#endif
+
+// music track; parked keeps the sequencer running while the voice is lent
+typedef struct _PsgTrack {
+	PsgEvent *events;
+	int num_events;
+	int voice;		// -1 while parked
+	Ch_Data parked;
+	// loop render cache: one pass of the track as rendered at cache_vol
+	int loop_len;	// frames per pass
+	short *cache;
+	int cache_fill;	// -1 until the capture starts at the top of the track
+	int cache_pos;	// next frame to play once cache_fill reaches loop_len
+	int cache_vol;
+} PsgTrack;
+
+static PsgTrack music[CH_NUM];
+static int  music_loops[CH_NUM];
+static size_t cache_budget = PSG_CACHE_BUDGET;
+static size_t cache_bytes = 0;
+
+static PsgStats stats;
+static PsgSeq sfx_seq[PSG_SFX_NUM];
+static char *macros[PSG_MACRO_NUM];
+static PsgPattern patterns[PSG_PATTERN_NUM];
+static int  num_patterns = 0;
+static char compiling[PSG_MACRO_NUM];	// macros being compiled, to stop recursion
+
 static int tone12_tbl[7] = {	0,  2,  4,  5,  7,  9, 11 };
 
 static float freq_tbl[84] = { 
@@ -175,48 +229,41 @@ static float freq_tbl[84] = {
 	2093.0, 2217.5, 2349.3, 2489.0, 2637.0, 2793.8, 2960.0, 3136.0, 3322.4, 3520.0, 3729.3, 3951.1,
 };
 
-static short GenTableToneWave(Ch_Data *inst)
+// recalculate the phase increment after fr_value or fr_tune has changed
+static void UpdateOscillator(Ch_Data *inst)
 {
-	int freq_value = inst->fr_value + inst->fr_tune;
-	float int_pos = 256 * inst->fr_counter / freq_value;
-	short data;
-
-	data = tone_tbl[inst->tone_no - FIRST_TBL_TONE][(int)(int_pos)] << 8;
+	int period;
 
-	if (++inst->fr_counter >= freq_value) inst->fr_counter = 0;
-	return (data);
+	if (inst->fr_value == VAL_NO_TONE) {
+		inst->osc.inc = 0;
+		return;
+	}
+	period = inst->fr_value + (inst->fr_tune << PSG_PERIOD_SHIFT);
+	inst->osc.inc = psg_osc_inc_from_period((period > 0)? period: 0);
 }
 
-static short GenPsgWave(Ch_Data *inst)
+// renders n samples of the current note into out
+static void GenAudioWaveform(Ch_Data *inst, short *out, int n, int gain)
 {
-	short data;
-	float tone_dur = inst->len * inst->tone_rate / 8;
-	float pwm_dur;
-	int freq_value = inst->fr_value + inst->fr_tune;
-
-	if ((int)tone_dur < inst->slice_pos) {
-		data = 0x0;
-	} else {
-		pwm_dur = (freq_value) * (100 - inst->pwm_rate) / 100;
-		if (inst->fr_counter < (int)pwm_dur)
-			data = 0x0;
-		else
-			data = 0x7FFF;
-	}
+	int active = n;
 
-	if (++inst->fr_counter >= freq_value) inst->fr_counter = 0;
+	// the key is released after gate_len (q command)
+	if (inst->slice_pos > inst->gate_len)
+		active = 0;
+	else if (inst->slice_pos + n > inst->gate_len + 1)
+		active = inst->gate_len + 1 - inst->slice_pos;
 
-	return (data);
-}
+	if (inst->tone_no >= FIRST_TBL_TONE && inst->tone_no < TBL_tone_no + FIRST_TBL_TONE) {
+		// table tone keeps sounding after the key release
+		psg_osc_render_table(&inst->osc, tone_tbl[inst->tone_no - FIRST_TBL_TONE], out, n, gain);
+		return;
+	}
 
-static short GenAudioWaveform(Ch_Data *inst)
-{
-	if (inst->tone_no < FIRST_TBL_TONE)
-		return (GenPsgWave(inst));
-	else if (inst->tone_no < TBL_tone_no + FIRST_TBL_TONE)
-		return (GenTableToneWave(inst));
-	else
-		return (GenPsgWave(inst));
+	psg_osc_render_pulse(&inst->osc, out, active, gain);
+	if (active < n) {
+		memset(&out[active], 0, (n - active) * sizeof(short));
+		psg_osc_skip(&inst->osc, n - active);
+	}
 }
 
 static void InitToneTable(int num)
@@ -267,15 +314,6 @@ static void InitToneTable(int num)
 	}
 }
 
-static void SkipDigits(Ch_Data *inst)
-{
-	char ch = inst->mml[inst->mml_pos];
-	while (isdigit(ch)) {
-		inst->mml_pos++;
-		ch = inst->mml[inst->mml_pos];
-	}
-}
-
 static void ProcessPitch(Ch_Data *inst)
 {
 	if (!inst->pitch_no)
@@ -336,233 +374,862 @@ static void ProcessEnvelope(Ch_Data *inst)
 	}
 }
 
-void PlayMusicSlice(int debug_mode)
+static void InitPsg(void)
+{
+	int i;
+
+	for (i = FIRST_TBL_TONE; i < FIRST_TBL_TONE + TBL_tone_no; i++)
+		InitToneTable(i);
+
+	// Q16 period keeps the fraction for better tuning
+	for (i = 0; i < NUM_KEYS; i++)
+		period_tbl[i] = (u32)(PSG_SAMPLE_RATE * 65536.0 / freq_tbl[i]);
+
+	init_psg = 1;
+	for (i = 0; i < CH_NUM; i++) {
+		if (!music[i].events)
+			AttachMMLData(i, default_mml[i]);
+	}
+}
+
+// reads a decimal number (0 if none) and moves *pp behind it
+static int ReadNumber(const char **pp)
+{
+	int value = 0;
+
+	while (isdigit(**pp)) {
+		value = value * 10 + (**pp - '0');
+		(*pp)++;
+	}
+	return (value);
+}
+
+// appends an event; the list grows as needed
+static void AddEvent(MmlList *list, int cmd, int flags, int value, int len)
+{
+	PsgEvent *events;
+	int size;
+
+	if (list->failed) return;
+	if (list->num >= list->size) {
+		size = (list->size)? list->size * 2: 64;
+		events = (PsgEvent *)realloc(list->events, size * sizeof(PsgEvent));
+		if (!events) {
+			printf("Error: Cannot allocate MML event list.\n");
+			list->failed = 1;
+			return;
+		}
+		list->events = events;
+		list->size   = size;
+	}
+	list->events[list->num].cmd   = cmd;
+	list->events[list->num].flags = flags;
+	list->events[list->num].value = value;
+	list->events[list->num].len   = len;
+	list->num++;
+}
+
+static int SameState(const MmlState *a, const MmlState *b)
+{
+	return (a->tempo == b->tempo && a->keylen == b->keylen && a->octave == b->octave &&
+		a->def_len == b->def_len && a->tie == b->tie);
+}
+
+static void CompileBody(MmlList *list, MmlState *st, const char **pp, int depth, int loop);
+
+// compiles a macro for the state at the call, as if called from the
+// top level, so the pattern is the same whoever calls it
+static PsgPattern *CompilePattern(int id, const MmlState *st)
+{
+	PsgPattern *pat;
+	MmlList list;
+	MmlState out = *st;
+	const char *p;
+
+	if (!macros[id]) {
+		printf("Error: MML macro $%c is not defined.\n", 'A' + id);
+		return (NULL);
+	}
+	if (compiling[id]) {
+		printf("Error: MML macro $%c calls itself.\n", 'A' + id);
+		return (NULL);
+	}
+
+	memset(&list, 0, sizeof(list));
+	p = macros[id];
+	compiling[id] = 1;
+	CompileBody(&list, &out, &p, 1, 0);
+	compiling[id] = 0;
+	if (list.failed || num_patterns >= PSG_PATTERN_NUM) {
+		if (!list.failed) printf("Error: Too many MML patterns.\n");
+		free(list.events);
+		return (NULL);
+	}
+
+	pat = &patterns[num_patterns++];
+	pat->macro      = id;
+	pat->in         = *st;
+	pat->out        = out;
+	pat->events     = list.events;
+	pat->num_events = list.num;
+	pat->length     = list.length;
+	pat->num_keys   = list.num_keys;
+	pat->nest       = list.nest;
+	return (pat);
+}
+
+// returns the pattern of a macro compiled for the state at the call.
+// a macro called with the same o, l and t is compiled only once, and
+// the call is refused where the loops and calls in it would go deeper
+// than PSG_NEST_MAX.
+static PsgPattern *GetPattern(int id, const MmlState *st, int depth)
+{
+	PsgPattern *pat = NULL;
+	int i;
+
+	for (i = 0; i < num_patterns; i++) {
+		if (patterns[i].macro == id && SameState(&patterns[i].in, st)) {
+			pat = &patterns[i];
+			break;
+		}
+	}
+	if (!pat && !(pat = CompilePattern(id, st)))
+		return (NULL);
+	if (depth + pat->nest > PSG_NEST_MAX) {
+		printf("Error: MML nesting is too deep.\n");
+		return (NULL);
+	}
+	return (pat);
+}
+
+// [ ... ]n repeats the body n times (2 if omitted)
+static void CompileLoop(MmlList *list, MmlState *st, const char **pp, int depth)
+{
+	MmlState start = *st;
+	const char *body = *pp;
+	const char *p;
+	int begin = list->num;
+	int length = list->length;
+	int i, count;
+
+	if (depth >= PSG_NEST_MAX) {
+		printf("Error: MML nesting is too deep.\n");
+		CompileBody(list, st, pp, depth, 1);
+		ReadNumber(pp);
+		return;
+	}
+
+	AddEvent(list, EV_LOOP_BEGIN, 0, 0, 0);
+	CompileBody(list, st, pp, depth + 1, 1);
+	count = (isdigit(**pp))? ReadNumber(pp): 2;
+	if (count < 1) count = 1;
+	if (count > 255) count = 255;
+	if (list->failed) return;
+
+	if (SameState(&start, st)) {
+		// the sequencer jumps back to the event after EV_LOOP_BEGIN
+		list->events[begin].value = count;
+		AddEvent(list, EV_LOOP_END, 0, 0, list->num - begin);
+		list->length += (list->length - length) * (count - 1);
+		return;
+	}
+
+	// the body moves o, l or t, so each pass compiles differently
+	memmove(&list->events[begin], &list->events[begin + 1], (list->num - begin - 1) * sizeof(PsgEvent));
+	list->num--;
+	for (i = 1; i < count; i++) {
+		p = body;
+		CompileBody(list, st, &p, depth + 1, 1);
+	}
+}
+
+// compiles MML up to the end of the text, or the closing bracket with loop
+static void CompileBody(MmlList *list, MmlState *st, const char **pp, int depth, int loop)
 {
-	int i, j;
+	PsgPattern *pat;
+	const char *p = *pp;
+	int cmd, key, value, key_len, ilen, name;
 	float len;
-	float def_len;
-	char note;
-	int note_p;
+	char ch;
+
+	if (depth > list->nest) list->nest = depth;
+	while (*p) {
+		ch = tolower(*p++);
+
+		switch (ch) {
+		case '&':
+			st->tie = EVF_TIE;
+			break;
+		case 'q':
+			if (*p >= '1' && *p <= '8')
+				AddEvent(list, EV_TONE_RATE, 0, ReadNumber(&p), 0);
+			break;
+		case 'v':
+			value = ReadNumber(&p);
+			AddEvent(list, EV_VOLUME, 0, (value > 15)? 15: value, 0);
+			break;
+		case 'x':
+			AddEvent(list, EV_PWM_RATE, 0, ReadNumber(&p), 0);
+			break;
+		case 's':
+			AddEvent(list, EV_ENVELOPE, 0, ReadNumber(&p), 0);
+			break;
+		case 'm':
+			value = ReadNumber(&p);
+			AddEvent(list, EV_ENV_LEN, 0, (value < 1)? 1: value, 0);
+			break;
+		case '@':
+			AddEvent(list, EV_TONE, 0, ReadNumber(&p), 0);
+			break;
+		case 'p':
+			AddEvent(list, EV_PITCH, 0, ReadNumber(&p), 0);
+			break;
+		case 'h':
+			AddEvent(list, EV_TUNE_DEPTH, 0, ReadNumber(&p), 0);
+			break;
+		case 'o':
+			st->octave = ReadNumber(&p) - 1;
+			break;
+		case '>':
+			if (st->octave < 7) st->octave++;
+			else if (st->octave > 0) st->octave--;
+			break;
+		case '<':
+			if (st->octave > 0) st->octave--;
+			break;
+		case 't':
+		case 'l':
+			value = ReadNumber(&p);
+			if (ch == 't' && value) st->tempo  = value;
+			if (ch == 'l' && value) st->keylen = value;
+			st->def_len = (int)(800.0 * 60 * 60 / st->tempo * 4 / st->keylen);
+			break;
+		case 'r':
+		case 'a': case 'b': case 'c': case 'd':
+		case 'e': case 'f': case 'g':
+			cmd = EV_REST;
+			key = 0;
+			if (ch != 'r') {
+				if (ch < 'c') ch += 7; // a or b
+				key = tone12_tbl[ch - 'c'] + st->octave * 12; // 7 * 12 = 84 (keys)
+				if (*p == '#' || *p == '+') {
+					key++;
+					p++;
+				} else if (*p == '-') {
+					key--;
+					p++;
+				}
+				if (key >= 0 && key < NUM_KEYS) cmd = EV_NOTE;
+				else key = 0;
+			}
+			key_len = ReadNumber(&p);
+			if (!key_len)
+				len = st->def_len;
+			else
+				len = 800.0 * 60 * 60 / st->tempo * 4 / key_len;
+			ilen = (int)len;
+			if (*p == '.') {
+				ilen = (int)(ilen + len / 2);
+				p++;
+			}
+			if (ilen < 1) ilen = 1;
+			AddEvent(list, cmd, st->tie, key, ilen);
+			list->length += ilen;
+			list->num_keys++;
+			st->tie = 0;
+			break;
+		case '[':
+			CompileLoop(list, st, &p, depth);
+			break;
+		case ']':
+			if (!loop) break; // unmatched
+			*pp = p;
+			return;
+		case '$':
+			name = toupper(*p);
+			if (name < 'A' || name > 'Z') break;
+			p++;
+			pat = GetPattern(name - 'A', st, depth);
+			if (!pat) break;
+			AddEvent(list, EV_CALL, 0, pat - patterns, 0);
+			if (depth + pat->nest > list->nest) list->nest = depth + pat->nest;
+			list->length   += pat->length;
+			list->num_keys += pat->num_keys;
+			*st = pat->out;
+			break;
+		default: // not correct
+			break;
+		}
+	}
+	*pp = p;
+}
+
+// compiles MML text into an event list; length gets frames of one pass
+// returns number of events, 0 on failure
+static int CompileMML(const Ch_Data *inst, const char *mml, PsgEvent **result, int *length)
+{
+	MmlList list;
+	MmlState st;
+	const char *p = mml;
+
+	memset(&list, 0, sizeof(list));
+	st.tempo   = inst->tempo;
+	st.keylen  = inst->def_keylen;
+	st.octave  = inst->octave;
+	st.def_len = inst->def_len;
+	st.tie     = 0;
+	CompileBody(&list, &st, &p, 0, 0);
+
+	// sequencer needs at least one key to step on
+	if (!list.num_keys) {
+		AddEvent(&list, EV_REST, 0, 0, st.def_len);
+		list.length += st.def_len;
+	}
+	if (list.failed) {
+		free(list.events);
+		return 0;
+	}
+
+	*result = (PsgEvent *)realloc(list.events, list.num * sizeof(PsgEvent));
+	if (!*result) *result = list.events;
+	if (length) *length = list.length;
+	return (list.num);
+}
+
+// defines macro $A~$Z, used by MML attached after this.
+// patterns already compiled from an old definition stay until exit
+// because a voice may still be playing them.
+int PsgDefineMacro(char name, char *data)
+{
+	int i, id = toupper(name) - 'A';
+	char *text;
+
+	if (id < 0 || id >= PSG_MACRO_NUM) {
+		printf("Error: MML macro name must be A~Z.\n");
+		return (PST_FAILURE);
+	}
+	if (macros[id] && !strcmp(macros[id], data)) return (PST_SUCCESS);
+
+	text = strdup(data);
+	if (!text) {
+		printf("Error: Cannot allocate MML macro.\n");
+		return (PST_FAILURE);
+	}
+	free(macros[id]);
+	macros[id] = text;
+	for (i = 0; i < num_patterns; i++) {
+		if (patterns[i].macro == id) patterns[i].macro = -1;
+	}
+	return (PST_SUCCESS);
+}
+
+// steps the event list up to the next key (note or rest)
+// returns 0 when a sound effect has reached its end
+static int NextKey(Ch_Data *inst)
+{
+	const PsgEvent *ev;
+	PsgCall *call;
+	int key_set = 0;
+
+	while (!key_set) {
+		if (inst->ev_pos >= inst->num_events) {
+			if (inst->call_depth) {
+				// back from a macro
+				call = &inst->calls[--inst->call_depth];
+				inst->events     = call->events;
+				inst->num_events = call->num_events;
+				inst->ev_pos     = call->ev_pos;
+				continue;
+			}
+			if (inst->owner < 0) return 0; // sound effects play once
+			music_loops[inst->owner]++;
+			inst->ev_pos     = 0;
+			inst->loop_depth = 0;
+		}
+		ev = &inst->events[inst->ev_pos++];
+
+		switch (ev->cmd) {
+		// the compiler keeps within PSG_NEST_MAX; the checks only
+		// guard the stacks
+		case EV_LOOP_BEGIN:
+			if (inst->loop_depth < PSG_NEST_MAX)
+				inst->loop_cnt[inst->loop_depth++] = ev->value;
+			break;
+		case EV_LOOP_END:
+			if (!inst->loop_depth) break;
+			if (--inst->loop_cnt[inst->loop_depth - 1] > 0)
+				inst->ev_pos -= ev->len;
+			else
+				inst->loop_depth--;
+			break;
+		case EV_CALL:
+			if (inst->call_depth >= PSG_NEST_MAX) break;
+			call = &inst->calls[inst->call_depth++];
+			call->events     = inst->events;
+			call->num_events = inst->num_events;
+			call->ev_pos     = inst->ev_pos;
+			inst->events     = patterns[ev->value].events;
+			inst->num_events = patterns[ev->value].num_events;
+			inst->ev_pos     = 0;
+			break;
+		case EV_NOTE:
+			inst->fr_value = period_tbl[ev->value];
+			if (!(ev->flags & EVF_TIE))
+				inst->int_vol = inst->local_vol;
+			key_set = 1;
+			break;
+		case EV_REST:
+			inst->fr_value = VAL_NO_TONE;
+			key_set = 1;
+			break;
+		case EV_TONE_RATE:	inst->tone_rate  = ev->value; break;
+		case EV_VOLUME:		inst->local_vol  = ev->value; break;
+		case EV_PWM_RATE:	inst->pwm_rate   = ev->value; break;
+		case EV_ENVELOPE:	inst->env_no     = ev->value; break;
+		case EV_ENV_LEN:	inst->env_len    = ev->value; break;
+		case EV_TONE:		inst->tone_no    = ev->value; break;
+		case EV_PITCH:		inst->pitch_no   = ev->value; break;
+		case EV_TUNE_DEPTH:	inst->tune_depth = ev->value; break;
+		default:
+			break;
+		}
+	}
+
+	if (ev->flags & EVF_TIE) {
+		// bond between old and new key
+		inst->len += ev->len;
+	} else {
+		// start new key
+		inst->len        = ev->len;
+		inst->slice_pos  = 0;
+		inst->frame_pos  = 0;
+		inst->osc.phase  = 0;
+		inst->fr_tune    = 0;
+	}
+	// oscillator parameters are fixed for the key
+	inst->gate_len = inst->len * inst->tone_rate / 8;
+	inst->osc.duty = psg_osc_duty_from_pwm(inst->pwm_rate);
+	UpdateOscillator(inst);
+	return 1;
+}
+
+// renders one slice of a voice into out, or only advances it if out is NULL
+// returns the frame where a music track wrapped to its top, -1 if none
+static int RenderVoice(Ch_Data *inst, short *out, int vol)
+{
+	int i, n, loops;
+	int wrap = -1;
+
+	inst->frame_pos++;
+	ProcessEnvelope(inst);
+	ProcessPitch(inst);
+	UpdateOscillator(inst);
+
+	for (i = 0; i < PSG_FRAME_SIZE; i += n) {
+		// render up to the end of the current key at once
+		n = inst->len - inst->slice_pos;
+		if (n > PSG_FRAME_SIZE - i) n = PSG_FRAME_SIZE - i;
+		if (n > 0) {
+			if (!out)
+				psg_osc_skip(&inst->osc, n);
+			else if (inst->fr_value)
+				GenAudioWaveform(inst, &out[i], n, mixer_vol_curve[inst->int_vol] * mixer_vol_curve[vol]);
+			else
+				memset(&out[i], 0, n * sizeof(short));
+			inst->slice_pos += n;
+			continue;
+		}
+		n = 0;
+		loops = (inst->owner >= 0)? music_loops[inst->owner]: 0;
+		if (!NextKey(inst)) {
+			// end of sound effect: the voice returns to the pool
+			if (out) memset(&out[i], 0, (PSG_FRAME_SIZE - i) * sizeof(short));
+			inst->active = 0;
+			break;
+		}
+		if (inst->owner >= 0 && wrap < 0 && music_loops[inst->owner] != loops)
+			wrap = i;
+
+#ifdef _DEBUG
+		if (inst->owner == 0) {
+			printf("[PSG1] ev_pos = %d, fr_value = %d, pwm_rate = %d, len = %d\n", inst->ev_pos, inst->fr_value, inst->pwm_rate, inst->len);
+			printf("       slice_pos = %d, gate_len = %d\n", inst->slice_pos, inst->gate_len);
+		}
+#endif
+	}
+	return (wrap);
+}
+
+// takes a cache buffer for the track out of the budget
+// returns 0 if the track is not worth caching or does not fit
+static int AllocCache(PsgTrack *trk)
+{
+	size_t size = trk->loop_len * sizeof(short);
+
+	if (trk->cache) return 1;
+	// a pass shorter than a slice would wrap more than once per slice
+	if (trk->loop_len < PSG_FRAME_SIZE) return 0;
+	if (cache_bytes + size > cache_budget) return 0;
+
+	trk->cache = (short *)malloc(size);
+	if (!trk->cache) return 0;
+	cache_bytes += size;
+	return 1;
+}
+
+static void FreeCache(PsgTrack *trk)
+{
+	if (!trk->cache) return;
+	free(trk->cache);
+	cache_bytes -= trk->loop_len * sizeof(short);
+	trk->cache      = NULL;
+	trk->cache_fill = -1;
+}
+
+// renders a slice of a music track; out is NULL while the track is parked.
+// the pass after the first wrap is captured, then later passes are copied
+// from the cache while the sequencer keeps stepping silently, so the cache
+// stays in step and live rendering can resume at any slice.
+static void RenderTrack(PsgTrack *trk, Ch_Data *inst, short *out, int vol)
+{
+	int wrap, s, n;
+
+	if (trk->cache && trk->cache_vol != vol)
+		trk->cache_fill = -1; // the volume is baked into the cache
+
+	if (trk->cache && trk->cache_fill == trk->loop_len) {
+		RenderVoice(inst, NULL, vol);
+		for (s = 0; s < PSG_FRAME_SIZE; s += n) {
+			n = trk->loop_len - trk->cache_pos;
+			if (n > PSG_FRAME_SIZE - s) n = PSG_FRAME_SIZE - s;
+			if (out) memcpy(&out[s], &trk->cache[trk->cache_pos], n * sizeof(short));
+			trk->cache_pos += n;
+			if (trk->cache_pos >= trk->loop_len) trk->cache_pos = 0;
+		}
+		if (out) stats.cached++;
+		return;
+	}
+
+	wrap = RenderVoice(inst, out, vol);
+	if (!out) {
+		trk->cache_fill = -1; // a capture needs every frame of the pass
+		return;
+	}
+
+	if (!trk->cache || trk->cache_fill < 0) {
+		if (wrap < 0 || !AllocCache(trk)) return;
+		trk->cache_fill = 0;
+		trk->cache_vol  = vol;
+		s = wrap;
+	} else {
+		s = 0;
+	}
+	n = trk->loop_len - trk->cache_fill;
+	if (n > PSG_FRAME_SIZE - s) n = PSG_FRAME_SIZE - s;
+	memcpy(&trk->cache[trk->cache_fill], &out[s], n * sizeof(short));
+	trk->cache_fill += n;
+	// the rest of the slice is already the top of the next pass
+	if (trk->cache_fill == trk->loop_len)
+		trk->cache_pos = PSG_FRAME_SIZE - s - n;
+}
+
+// sets the memory for loop render caches in bytes, 0 to disable (the
+// default). a cached loop is replayed as first rendered, so it is not
+// bit-exact with live synthesis. caches are dropped and captured again
+// under the new budget.
+void PsgSetRenderCache(size_t budget)
+{
+	int j;
+
+	for (j = 0; j < CH_NUM; j++)
+		FreeCache(&music[j]);
+	cache_budget = budget;
+}
+
+// finds a voice for the priority; free voices first, then the lowest
+// priority (oldest on a tie) voice that is not above the request.
+// music voices are only taken by a strictly higher priority.
+// returns voice number, -1 if none
+static int AllocVoice(int priority, int steal)
+{
+	int i, victim = -1;
+	Ch_Data *v;
+
+	for (i = 0; i < PSG_VOICE_NUM; i++) {
+		if (!voice[i].active) {
+			voice_gen[i]++;
+			return (i);
+		}
+	}
+	if (!steal) return (-1);
+
+	for (i = 0; i < PSG_VOICE_NUM; i++) {
+		v = &voice[i];
+		if (v->priority > priority) continue;
+		if (v->owner >= 0 && v->priority == priority) continue;
+		if (victim < 0 || v->priority < voice[victim].priority ||
+			(v->priority == voice[victim].priority && v->age < voice[victim].age))
+			victim = i;
+	}
+	if (victim < 0) return (-1);
+
+	v = &voice[victim];
+	if (v->owner >= 0) {
+		// the track keeps time silently until a voice is free again
+		music[v->owner].parked = *v;
+		music[v->owner].voice  = -1;
+	}
+	v->active = 0;
+	voice_gen[victim]++;
+	return (victim);
+}
+
+static void BindTrack(int ch, int v)
+{
+	voice[v] = music[ch].parked;
+	voice[v].active   = 1;
+	voice[v].owner    = ch;
+	voice[v].priority = PSG_PRIO_MUSIC;
+	voice[v].age      = voice_age++;
+	music[ch].voice   = v;
+}
+
+// synthesizes one slice (PSG_FRAME_SIZE frames) into frames
+// without touching the audio output
+int PsgRenderSlice(u32 *frames)
+{
+	int j, num = 0;
 	int vol = azplf_audio_get_volume();
-	float data;
-	int num_data[CH_NUM];
-	int tone_set;
-	int key_len;
-	u32 pcm_data;
-	u32 l_pcm;
-	u32 r_pcm;
+	MixerChannel mix[PSG_VOICE_NUM];
 	Ch_Data *ppsg;
+	struct timespec t0, t1;
+	u32 ns;
+
+	if (!init_psg)
+		InitPsg();
+	clock_gettime(CLOCK_MONOTONIC, &t0);
 
-	if (!init_tonetbl) {
-		for (i = FIRST_TBL_TONE; i < FIRST_TBL_TONE + TBL_tone_no; i++)
-			InitToneTable(i);
-		init_tonetbl = 1;
+	for (j = 0; j < CH_NUM; j++) {
+		if (!music[j].events || music[j].voice >= 0) continue;
+		if ((music[j].voice = AllocVoice(PSG_PRIO_MUSIC, 0)) >= 0)
+			BindTrack(j, music[j].voice);
+		else
+			RenderTrack(&music[j], &music[j].parked, NULL, vol);
 	}
 
+	// inactive voices are neither rendered nor mixed
+	for (j = 0; j < PSG_VOICE_NUM; j++) {
+		ppsg = &voice[j];
+		if (!ppsg->active) continue;
+
+		if (ppsg->owner >= 0)
+			RenderTrack(&music[ppsg->owner], ppsg, pcm[j], vol);
+		else
+			RenderVoice(ppsg, pcm[j], vol);
+		mix[num].pcm  = pcm[j];
+		mix[num].gain = MIXER_GAIN_UNITY / PSG_MIX_HEADROOM;
+		mix[num].pan  = ppsg->pan;
+		num++;
+	}
+	mixer_mix(mix, num, frames, PSG_FRAME_SIZE);
+
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	ns = (t1.tv_sec - t0.tv_sec) * 1000000000 + (t1.tv_nsec - t0.tv_nsec);
+	stats.slices++;
+	stats.synth_ns += ns;
+	if (ns > stats.synth_ns_max) stats.synth_ns_max = ns;
+	if (num > stats.voices_max) stats.voices_max = num;
+	return (PSG_FRAME_SIZE);
+}
+
+// renders up to max_frames as fast as possible; with until_loop it stops
+// at the slice where every track has looped once.
+// returns number of frames rendered
+int PsgRenderMusic(u32 *frames, int max_frames, int until_loop)
+{
+	int pos = 0;
+	int n;
+
+	while (pos < max_frames) {
+		if (until_loop && PsgGetLoopCount() > 0) break;
+		n = max_frames - pos;
+		if (n >= PSG_FRAME_SIZE) {
+			pos += PsgRenderSlice(&frames[pos]);
+		} else {
+			PsgRenderSlice(out);
+			out_pos = PSG_FRAME_SIZE;
+			memcpy(&frames[pos], out, n * sizeof(u32));
+			pos += n;
+		}
+	}
+	return (pos);
+}
+
+// number of times the whole song has looped (the slowest track counts)
+int PsgGetLoopCount(void)
+{
+	int j, loops = -1;
+
+	for (j = 0; j < CH_NUM; j++) {
+		if (!music[j].events) continue;
+		if (loops < 0 || music_loops[j] < loops) loops = music_loops[j];
+	}
+	return ((loops < 0)? 0: loops);
+}
+
+void PsgGetStats(PsgStats *result)
+{
+	*result = stats;
+}
+
+void PsgResetStats(void)
+{
+	memset(&stats, 0, sizeof(stats));
+}
+
+void PlayMusicSlice(int debug_mode)
+{
+	int n, num;
+
 	if (skip_frame) {
 		skip_frame--;
 		return; // skipped at once
 	}
 
-	for (j = 0; j < CH_NUM; j++) {
-		num_data[j] = 0;
-		ppsg = &psg[j];
-
-		ppsg->frame_pos++;
-		ProcessEnvelope(ppsg);
-		ProcessPitch(ppsg);
-
-		for (i = 0; i < PSG_FRAME_SIZE; i++) {
-			if (ppsg->fr_value) {
-				data = GenAudioWaveform(ppsg);
-				data *= vol_curve[ppsg->int_vol] / 256 * vol_curve[vol] / 256;
-				pcm[j][num_data[j]++] = (u32)(((u16)data << 16) | (u16)data); // L=data; R=data
-			}
-	
-			if (ppsg->len && ++ppsg->slice_pos < ppsg->len) continue;
-	
-			tone_set = 0;
-			while (!tone_set) {
-				if (!ppsg->mml[ppsg->mml_pos]) ppsg->mml_pos = 0;
-	
-				note = tolower(ppsg->mml[ppsg->mml_pos++]);
-	
-				if (note < '#' || note == '.' || isdigit(note)) // not correct
-					continue;
-	
-				if (note == '&') {
-					ppsg->tie = 1;
-					continue;
-				}
-	
-				if (note == 'q') {
-					note = ppsg->mml[ppsg->mml_pos];
-					if (note >= '1' && note <= '8') {
-						ppsg->tone_rate = atoi(&ppsg->mml[ppsg->mml_pos]);
-						SkipDigits(ppsg);
-					}
-					continue;
-				}
-	
-				if (note == 'v') {
-					ppsg->local_vol = atoi(&ppsg->mml[ppsg->mml_pos]);
-					SkipDigits(ppsg);
-					continue;
-				}
-	
-				if (note == 'o') {
-					ppsg->octave = atoi(&ppsg->mml[ppsg->mml_pos]) - 1;
-					SkipDigits(ppsg);
-					continue;
-				}
-	
-				if (note == '>' || note == '<') {
-					if (note == '>' && ppsg->octave < 7)
-						ppsg->octave++;
-					else if (ppsg->octave > 0)
-						ppsg->octave--;
-					continue;
-				}
-	
-				if (note == 'x') {
-					ppsg->pwm_rate = atoi(&ppsg->mml[ppsg->mml_pos]);
-					SkipDigits(ppsg);
-					continue;
-				}
-	
-				if (note == 's') {
-					ppsg->env_no = atoi(&ppsg->mml[ppsg->mml_pos]);
-					SkipDigits(ppsg);
-					continue;
-				}
-	
-				if (note == 'm') {
-					ppsg->env_len = atoi(&ppsg->mml[ppsg->mml_pos]);
-					if (ppsg->env_len < 0) ppsg->env_len = 1;
-					SkipDigits(ppsg);
-					continue;
-				}
-	
-				if (note == '@') {
-					ppsg->tone_no = atoi(&ppsg->mml[ppsg->mml_pos]);
-					SkipDigits(ppsg);
-					continue;
-				}
-	
-				if (note == 'p') {
-					ppsg->pitch_no = atoi(&ppsg->mml[ppsg->mml_pos]);
-					SkipDigits(ppsg);
-					continue;
-				}
-	
-				if (note == 'h') {
-					ppsg->tune_depth = atoi(&ppsg->mml[ppsg->mml_pos]);
-					SkipDigits(ppsg);
-					continue;
-				}
-	
-				if (note == 't' || note == 'l') {
-					def_len = 800 * 60; // 1min
-					if (note == 't')
-						ppsg->tempo = atoi(&ppsg->mml[ppsg->mml_pos]);
-					else if (note == 'l')
-						ppsg->def_keylen = atoi(&ppsg->mml[ppsg->mml_pos]);
-					def_len = def_len * 60 / ppsg->tempo * 4 / ppsg->def_keylen;
-					ppsg->def_len = (int)def_len;
-					SkipDigits(ppsg);
-					continue;
-				}
-		
-				if (note == 'r') {
-					ppsg->fr_value = VAL_NO_TONE;
-					tone_set = 1;
-				} else {
-					if (note < 'c') note += 7; // a or b
-					note_p = tone12_tbl[note - 'c'] + ppsg->octave * 12; // 7 * 12 = 84 (keys)
-		
-					if (note_p > sizeof(freq_tbl)/sizeof(freq_tbl[0])) {
-						ppsg->fr_value = VAL_NO_TONE;
-					} else {
-						if (ppsg->mml[ppsg->mml_pos] == '#' || ppsg->mml[ppsg->mml_pos] == '+') {
-							note_p++;
-							ppsg->mml_pos++;
-						} else if (ppsg->mml[ppsg->mml_pos] == '-') {
-							note_p--;
-							ppsg->mml_pos++;
-						}
-						len = 48000.0 / freq_tbl[note_p];
-						ppsg->fr_value = (int)len;
-						if (!ppsg->tie) 
-							ppsg->int_vol = ppsg->local_vol;
-					}
-					tone_set = 1;
-				}
-	
-				if (tone_set) {
-					key_len = atoi(&ppsg->mml[ppsg->mml_pos]);
-					if (!key_len)  {
-						len = ppsg->def_len;
-					} else {
-						SkipDigits(ppsg);
-						len = 800 * 60; // 1min
-						len = len * 60 / ppsg->tempo * 4 / key_len;
-					}
-					if (ppsg->tie) {
-						// bond between old and new key
-						ppsg->len += len;
-						ppsg->tie  = 0;
-					} else {
-						// start new key
-						ppsg->len        = len;
-						ppsg->slice_pos  = 0;
-						ppsg->frame_pos  = 0;
-						ppsg->fr_counter = 0;
-						ppsg->fr_tune    = 0;
-					}
-					if (ppsg->mml[ppsg->mml_pos] == '.') {
-						ppsg->len += len / 2;
-						ppsg->mml_pos++;
-					}
-				}
-	
-#ifdef _DEBUG
-				if (j == 0) {
-					printf("[PSG1] mml_pos = %d, fr_value = %d, pwm_rate = %d, len = %d\n", ppsg->mml_pos, ppsg->fr_value, ppsg->pwm_rate, ppsg->len);
-					printf("       slice_pos = %d, tempo = %d, def_len = %d, def_keylen = %d\n", ppsg->slice_pos, ppsg->tempo, ppsg->def_len, ppsg->def_keylen);
-				}
-#endif
-			}
+	// as many frames as the audio output asks for; the rest of a slice
+	// waits in out for the next call
+	n = azplf_audio_get_request();
+	while (n > 0) {
+		if (out_pos >= PSG_FRAME_SIZE) {
+			PsgRenderSlice(out);
+			azplf_audio_process_fx(AUDIO_BUS_MUSIC, out, PSG_FRAME_SIZE);
+			out_pos = 0;
 		}
+		num = PSG_FRAME_SIZE - out_pos;
+		if (num > n) num = n;
+		azplf_audio_write(&out[out_pos], num);
+		out_pos += num;
+		n -= num;
 	}
-	for (i = 0; i < num_data[0]; i++) {
-		while ((i2sout_getstatus(0x0C) & 0xC));
+}
+
+// MML is compiled here, so no text parsing is left in PlayMusicSlice
+void AttachMMLData(int ch, char *data)
+{
+	PsgEvent *events;
+	PsgEvent *old;
+	Ch_Data *inst;
+	int num, v, length;
+
+	if (ch < 0 || ch >= CH_NUM) return;
+	if (!init_psg)
+		InitPsg();
+
+	num = CompileMML(&voice_template, data, &events, &length);
+	if (!num) return;
+
+	old = music[ch].events;
+	music[ch].events     = events;
+	music[ch].num_events = num;
+	music_loops[ch]      = 0;
+	FreeCache(&music[ch]);
+	music[ch].loop_len   = length;
+	music[ch].cache_fill = -1;
 
-		l_pcm = (pcm[0][i] >> 16) + 
-				(pcm[1][i] >> 16) + 
-				(pcm[2][i] >> 16) + 
-				(pcm[3][i] >> 16);
-		r_pcm = (pcm[0][i] & 0xffff) + 
-				(pcm[1][i] & 0xffff) + 
-				(pcm[2][i] & 0xffff) + 
-				(pcm[3][i] & 0xffff);
-		pcm_data = (l_pcm >> 2) << 16 | (r_pcm >> 2);
-		i2sout_senddata(4, pcm_data);
+	if (!old) {
+		// first attach: the track borrows a voice from the pool
+		music[ch].parked       = voice_template;
+		music[ch].parked.owner = ch;
+		music[ch].parked.pan   = MIXER_PAN_CENTER;
+		music[ch].voice        = -1;
+		if ((v = AllocVoice(PSG_PRIO_MUSIC, 1)) >= 0)
+			BindTrack(ch, v);
 	}
+
+	inst = (music[ch].voice >= 0)? &voice[music[ch].voice]: &music[ch].parked;
+	inst->events     = events;
+	inst->num_events = num;
+	inst->ev_pos     = 0;
+	inst->loop_depth = 0;
+	inst->call_depth = 0;
+	inst->len        = 0; // start from the next slice
+	inst->slice_pos  = 0;
+	if (old) free(old);
 }
 
-void AttachMMLData(int ch, char *data)
+// compiles a sound effect and returns its id, -1 on failure
+int PsgLoadSfx(char *data)
 {
-	if (ch < 0 || ch > CH_NUM) return;
+	int id;
 
-	strcpy(psg[ch].mml, data);
+	for (id = 0; id < PSG_SFX_NUM; id++) {
+		if (!sfx_seq[id].events) break;
+	}
+	if (id >= PSG_SFX_NUM) {
+		printf("Error: Too many sound effects.\n");
+		return (-1);
+	}
+
+	sfx_seq[id].num_events = CompileMML(&voice_template, data, &sfx_seq[id].events, NULL);
+	if (!sfx_seq[id].num_events) return (-1);
+	return (id);
 }
 
+// starts a sound effect on a voice from the pool
+// returns a handle for PsgStopVoice, -1 if all voices are busy with
+// higher priority
+int PsgPlaySfx(int id, int priority, int pan)
+{
+	Ch_Data *inst;
+	int v;
+
+	if (id < 0 || id >= PSG_SFX_NUM || !sfx_seq[id].events) return (-1);
+	if (!init_psg)
+		InitPsg();
+
+	v = AllocVoice(priority, 1);
+	if (v < 0) return (-1);
+
+	inst = &voice[v];
+	*inst = voice_template;
+	inst->events     = sfx_seq[id].events;
+	inst->num_events = sfx_seq[id].num_events;
+	inst->active     = 1;
+	inst->owner      = -1;
+	inst->priority   = priority;
+	inst->pan        = pan;
+	inst->age        = voice_age++;
+	return (VOICE_HANDLE(v));
+}
+
+// stops the sound effect started as handle; nothing happens once it has
+// ended or its voice went to another sound, and music is left playing
+void PsgStopVoice(int handle)
+{
+	int v = HANDLE_VOICE(handle);
+
+	if (handle < 0 || v >= PSG_VOICE_NUM) return;
+	if (VOICE_HANDLE(v) != handle) return;
+	if (voice[v].owner < 0) voice[v].active = 0;
+}
+
+int PsgGetActiveVoices(void)
+{
+	int i, num = 0;
+
+	for (i = 0; i < PSG_VOICE_NUM; i++) {
+		if (voice[i].active) num++;
+	}
+	return (num);
+}
+
+// one line per channel; a line "$A=..." defines macro $A instead
 int LoadMMLData(char *fn)
 {
 	FILE *fp;
 	int ch = 0;
-	char data[MAX_MML_LEN];
-	char *p;
+	char *data = NULL;
+	size_t size = 0;
 
 	fp = fopen(fn, "r");
 	if (!fp) {
@@ -570,10 +1237,15 @@ int LoadMMLData(char *fn)
 		return (PST_FAILURE);
 	}
 
-	while (p = fgets(data, sizeof(data), fp)) {
+	while (getline(&data, &size, fp) != -1) {
+		if (data[0] == '$' && isalpha(data[1]) && data[2] == '=') {
+			PsgDefineMacro(data[1], &data[3]);
+			continue;
+		}
 		AttachMMLData(ch, data);
 		if (++ch >= CH_NUM) break;
 	}
+	free(data);
 	fclose(fp);
 	return (PST_SUCCESS);
 }
@@ -0,0 +1,160 @@
+/******************************************************
+ *    Filename:     resampler.c
+ *     Purpose:     sample rate converter
+ *  Target Plf:     ZYBO (azplf)
+ *  Created on: 	2026/10/17
+ * Modified on:
+ *      Author: 	atsupi.com
+ *     Version:		0.90
+ ******************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "azplf_bsp.h"
+#include "resampler.h"
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define RESAMPLE_NEON
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define RESAMPLE_SSE2
+#endif
+
+#define SINC_CUTOFF				0.95	// of the lower Nyquist frequency
+
+static inline short saturate(int value)
+{
+	if (value >  32767) return ( 32767);
+	if (value < -32768) return (-32768);
+	return ((short)value);
+}
+
+// Blackman windowed sinc, each phase normalized to unity gain
+static void make_coef(Resampler *rs, double cutoff)
+{
+	int p, k, sum;
+	double x, w, h[RESAMPLE_TAPS], total;
+
+	for (p = 0; p < RESAMPLE_PHASES; p++) {
+		total = 0;
+		for (k = 0; k < RESAMPLE_TAPS; k++) {
+			// distance from the output position to tap k (middle of the phase)
+			x = k - (RESAMPLE_TAPS / 2 - 1) - (p + 0.5) / RESAMPLE_PHASES;
+			w = 0.42 + 0.5 * cos(M_PI * x / (RESAMPLE_TAPS / 2)) +
+				0.08 * cos(2 * M_PI * x / (RESAMPLE_TAPS / 2));
+			h[k] = (x == 0)? cutoff: sin(M_PI * cutoff * x) / (M_PI * x);
+			h[k] *= w;
+			total += h[k];
+		}
+		sum = 0;
+		for (k = 0; k < RESAMPLE_TAPS; k++) {
+			rs->coef[p][k] = (short)floor(h[k] / total * 32767 + 0.5);
+			sum += rs->coef[p][k];
+		}
+		rs->coef[p][RESAMPLE_TAPS / 2 - 1] += 32767 - sum; // rounding error
+	}
+}
+
+#if defined(RESAMPLE_NEON)
+
+static inline int dot_taps(const short *s, const short *c)
+{
+	int32x4_t acc = vmull_s16(vld1_s16(s), vld1_s16(c));
+	int32x2_t sum;
+
+	acc = vmlal_s16(acc, vld1_s16(s + 4),  vld1_s16(c + 4));
+	acc = vmlal_s16(acc, vld1_s16(s + 8),  vld1_s16(c + 8));
+	acc = vmlal_s16(acc, vld1_s16(s + 12), vld1_s16(c + 12));
+	sum = vpadd_s32(vget_low_s32(acc), vget_high_s32(acc));
+	return (vget_lane_s32(vpadd_s32(sum, sum), 0));
+}
+
+#elif defined(RESAMPLE_SSE2)
+
+static inline int dot_taps(const short *s, const short *c)
+{
+	__m128i acc = _mm_add_epi32(
+		_mm_madd_epi16(_mm_loadu_si128((const __m128i *)s), _mm_loadu_si128((const __m128i *)c)),
+		_mm_madd_epi16(_mm_loadu_si128((const __m128i *)(s + 8)), _mm_loadu_si128((const __m128i *)(c + 8))));
+	acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(1, 0, 3, 2)));
+	acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(2, 3, 0, 1)));
+	return (_mm_cvtsi128_si32(acc));
+}
+
+#else
+
+static inline int dot_taps(const short *s, const short *c)
+{
+	int k, sum = 0;
+
+	for (k = 0; k < RESAMPLE_TAPS; k++)
+		sum += s[k] * c[k];
+	return (sum);
+}
+
+#endif
+
+void resampler_reset(Resampler *rs)
+{
+	// history of zeros puts the first output on the first input sample
+	rs->fill = rs->taps / 2 - 1;
+	memset(rs->buf, 0, sizeof(rs->buf));
+	rs->pos = 0;
+}
+
+void resampler_init(Resampler *rs, u32 in_rate, u32 out_rate, int mode)
+{
+	double cutoff = SINC_CUTOFF;
+
+	rs->mode = mode;
+	rs->taps = (mode == RESAMPLE_SINC)? RESAMPLE_TAPS: 2;
+	rs->step = (u32)(((u64)in_rate << 16) / out_rate);
+	if (!rs->step) rs->step = 1;
+
+	// downsampling lowers the cutoff to the output Nyquist frequency
+	if (in_rate > out_rate) cutoff *= (double)out_rate / in_rate;
+	if (mode == RESAMPLE_SINC) make_coef(rs, cutoff);
+	resampler_reset(rs);
+}
+
+int resampler_process(Resampler *rs, const short *in, int n, short *out, int max_out)
+{
+	const short *s;
+	int done = 0, num = 0;
+	int i, k, f;
+
+	while (done < n) {
+		k = RESAMPLE_TAPS + RESAMPLE_CHUNK - rs->fill;
+		if (k > n - done) k = n - done;
+		if (!k) break; // out is full
+		memcpy(&rs->buf[rs->fill], &in[done], k * sizeof(short));
+		rs->fill += k;
+		done += k;
+
+		if (rs->mode == RESAMPLE_SINC) {
+			while ((int)(rs->pos >> 16) + RESAMPLE_TAPS <= rs->fill && num < max_out) {
+				s = &rs->buf[rs->pos >> 16];
+				f = (rs->pos & 0xFFFF) >> (16 - RESAMPLE_PHASE_BITS);
+				out[num++] = saturate(dot_taps(s, rs->coef[f]) >> 15);
+				rs->pos += rs->step;
+			}
+		} else {
+			while ((int)(rs->pos >> 16) + 2 <= rs->fill && num < max_out) {
+				s = &rs->buf[rs->pos >> 16];
+				f = (rs->pos & 0xFFFF) >> 1;
+				out[num++] = s[0] + (((s[1] - s[0]) * f) >> 15);
+				rs->pos += rs->step;
+			}
+		}
+
+		// keep the samples the next outputs still need
+		i = rs->pos >> 16;
+		if (i > rs->fill) i = rs->fill;
+		memmove(rs->buf, &rs->buf[i], (rs->fill - i) * sizeof(short));
+		rs->fill -= i;
+		rs->pos  -= (u32)i << 16;
+	}
+	return (num);
+}
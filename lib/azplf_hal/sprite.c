@@ -65,7 +65,7 @@ void drawSpriteWithAnimation(Sprite *inst, u32 wrBufAddr, u32 system_time)
 			size_y = inst->dy;
 			pos_x  = inst->x;
 			pos_y  = inst->y;
-			gfxaccel_bitblt(l_ptGfxaccel, 
+			gfxaccel_submit_bitblt(l_ptGfxaccel, 
 				l_resAddr, res_x, res_y, size_x, size_y, 
 				wrBufAddr, pos_x, pos_y, 
 				GFXACCEL_BB_AND);
@@ -76,7 +76,7 @@ void drawSpriteWithAnimation(Sprite *inst, u32 wrBufAddr, u32 system_time)
 		size_y = inst->dy;
 		pos_x  = inst->x;
 		pos_y  = inst->y;
-		gfxaccel_bitblt(l_ptGfxaccel, 
+		gfxaccel_submit_bitblt(l_ptGfxaccel, 
 			l_resAddr, res_x, res_y, size_x, size_y, 
 			wrBufAddr, pos_x, pos_y, 
 			GFXACCEL_BB_OR);
@@ -106,7 +106,7 @@ void drawSprite(Sprite *inst, u32 wrBufAddr, u32 system_time)
 		size_y = inst->dy;
 		pos_x  = inst->x;
 		pos_y  = inst->y;
-		gfxaccel_bitblt(l_ptGfxaccel, 
+		gfxaccel_submit_bitblt(l_ptGfxaccel, 
 			l_resAddr, res_x, res_y, size_x, size_y, 
 			wrBufAddr, pos_x, pos_y, 
 			GFXACCEL_BB_NONE);
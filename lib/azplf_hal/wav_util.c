@@ -9,8 +9,15 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "azplf_bsp.h"
 #include "wav_util.h"
+#include "pcm_convert.h"
+#include "ima_adpcm.h"
 
 //#define _DEBUG
 
@@ -36,38 +43,345 @@ static int read4byte(FILE *fp, u32 *result)
 	return 4;
 }
 
-int wav_readfile(WavHeader *header, char *fn)
+// reads RIFF header up to the size of the data chunk.
+// chunks other than fmt and data (LIST, fact, ...) are skipped.
+// fails without a fmt chunk before the data chunk
+static int wav_readheader(FILE *fp, WavHeader *header)
 {
-	FILE *fp;
-	int result;
+	u8 id[4];
+	u32 size;
+	long next;
 
-	fp = fopen(fn, "r");
-	printf("File opened with id(0x%x)\r\n", (unsigned int)fp);
+	header->cbuf = 0;
+	header->data = 0;
+	header->map  = 0;
+	header->fmt_chnk = 0;
 	read1byte(fp, header->RIFF, 4);
 	read4byte(fp, &header->riff_size);
 	read1byte(fp, header->riff_kind, 4);
-	read1byte(fp, header->fmt, 4);					// fmt chunk
-	read4byte(fp, &header->fmt_chnk);				// Nbytes of fmt chunk
-	read2byte(fp, &header->fmt_id);
-	read2byte(fp, &header->Nch);
-	read4byte(fp, &header->fs);
-	read4byte(fp, &header->dts);
-	read2byte(fp, &header->bl_size);
-	read2byte(fp, &header->bit);
-
-	if (header->fmt_chnk != 16)					// extension chunk
-	{
-		read2byte(fp, &header->fmt_ext_size);		// Nbytes for extension
-		header->cbuf = (char *)calloc((size_t)header->fmt_ext_size, sizeof(u8));
-		read1byte(fp, header->cbuf, header->fmt_ext_size);
-	}
-	read1byte(fp, header->data_chnk, 4);			// data chunk
-	read4byte(fp, &header->Nbyte);
-	header->data = calloc(header->Nbyte, sizeof(short));
-	if ((result = read1byte(fp, (char *)header->data, header->Nbyte)) < header->Nbyte)
-		result = 1;
+
+	while (read1byte(fp, id, 4) == 4) {
+		read4byte(fp, &size);
+		next = ftell(fp) + size + (size & 1);		// chunks are word aligned
+		if (!memcmp(id, "data", 4)) {
+			if (header->fmt_chnk < 16) break;
+			memcpy(header->data_chnk, id, 4);		// data chunk
+			header->Nbyte = size;
+			return (PST_SUCCESS);
+		}
+		if (!memcmp(id, "fmt ", 4)) {
+			memcpy(header->fmt, id, 4);				// fmt chunk
+			header->fmt_chnk = size;				// Nbytes of fmt chunk
+			read2byte(fp, &header->fmt_id);
+			read2byte(fp, &header->Nch);
+			read4byte(fp, &header->fs);
+			read4byte(fp, &header->dts);
+			read2byte(fp, &header->bl_size);
+			read2byte(fp, &header->bit);
+			if (header->fmt_chnk > 16 && !header->cbuf)	// extension chunk
+			{
+				read2byte(fp, &header->fmt_ext_size);	// Nbytes for extension
+				header->cbuf = (char *)calloc((size_t)header->fmt_ext_size, sizeof(u8));
+				read1byte(fp, header->cbuf, header->fmt_ext_size);
+			}
+		}
+		fseek(fp, next, SEEK_SET);
+	}
+	header->Nbyte = 0;
+	return (PST_FAILURE);
+}
+
+// reads the whole data chunk into header->data
+int wav_readfile(WavHeader *header, char *fn)
+{
+	FILE *fp;
+
+	fp = fopen(fn, "r");
+	if (!fp) {
+		printf("Error: Cannot open WAV file %s.\n", fn);
+		return (PST_FAILURE);
+	}
+	if (wav_readheader(fp, header) != PST_SUCCESS) {
+		printf("Error: data chunk not found.\n");
+		free_wavheader(header);
+		fclose(fp);
+		return (PST_FAILURE);
+	}
+	header->data = calloc(header->Nbyte, sizeof(u8));
+	if ((!header->data && header->Nbyte) ||
+		read1byte(fp, (char *)header->data, header->Nbyte) < header->Nbyte) {
+		printf("Error: WAV data is shorter than %u bytes.\n", header->Nbyte);
+		free_wavheader(header);
+		fclose(fp);
+		return (PST_FAILURE);
+	}
 	fclose(fp);
-	return (result);
+	return (PST_SUCCESS);
+}
+
+// compressed stream: one block is read and decoded at a time
+static int wav_openadpcm(WavStream *stream)
+{
+	WavHeader *header = &stream->header;
+	int rest;
+
+	stream->block_frames = IMA_BLOCK_FRAMES(header->bl_size, header->Nch);
+	if (header->bl_size < 4 * header->Nch || stream->block_frames < 1) {
+		printf("Error: Broken IMA-ADPCM block size %d.\n", header->bl_size);
+		wav_closestream(stream);
+		return (PST_FAILURE);
+	}
+	stream->block_raw = (u8 *)malloc(header->bl_size);
+	stream->block_pcm = (short *)malloc(stream->block_frames * header->Nch * sizeof(short));
+	if (!stream->block_raw || !stream->block_pcm) {
+		printf("Error: Cannot allocate IMA-ADPCM block.\n");
+		wav_closestream(stream);
+		return (PST_FAILURE);
+	}
+	stream->block_pos = stream->block_len = 0;
+
+	// the last block may be short
+	stream->remain = header->Nbyte / header->bl_size * stream->block_frames;
+	rest = header->Nbyte % header->bl_size;
+	if (rest >= 4 * header->Nch)
+		stream->remain += IMA_BLOCK_FRAMES(rest, header->Nch);
+	return (PST_SUCCESS);
+}
+
+static int wav_readadpcm(WavStream *stream, short *buf, int num)
+{
+	int nch = stream->header.Nch;
+	int k, n, done = 0;
+
+	while (done < num) {
+		if (stream->block_pos >= stream->block_len) {
+			n = fread(stream->block_raw, 1, stream->header.bl_size, stream->fp);
+			stream->block_len = ima_decode_block(stream->block_raw, n, nch, stream->block_pcm);
+			stream->block_pos = 0;
+			if (!stream->block_len) break;
+		}
+		k = stream->block_len - stream->block_pos;
+		if (k > num - done) k = num - done;
+		memcpy(&buf[done * nch], &stream->block_pcm[stream->block_pos * nch], k * nch * sizeof(short));
+		stream->block_pos += k;
+		done += k;
+	}
+	return (done);
+}
+
+// opens a WAV file for block reads; only the header stays in memory
+int wav_openstream(WavStream *stream, char *fn)
+{
+	stream->block_raw = 0;
+	stream->block_pcm = 0;
+	stream->fp = fopen(fn, "rb");
+	if (!stream->fp) {
+		printf("Error: Cannot open WAV file.\n");
+		return (PST_FAILURE);
+	}
+	if (wav_readheader(stream->fp, &stream->header) != PST_SUCCESS) {
+		printf("Error: data chunk not found.\n");
+		wav_closestream(stream);
+		return (PST_FAILURE);
+	}
+	if (stream->header.fmt_id == WAV_FORMAT_IMA_ADPCM && stream->header.Nch)
+		return (wav_openadpcm(stream));
+	if (!pcm_supported(stream->header.fmt_id, stream->header.bit) || !stream->header.Nch) {
+		printf("Error: WAV format %d with %d bits is not supported.\n",
+			stream->header.fmt_id, stream->header.bit);
+		wav_closestream(stream);
+		return (PST_FAILURE);
+	}
+	// wav_readstream converts at least one whole frame at a time
+	stream->frame_bytes = stream->header.Nch * stream->header.bit / 8;
+	if (stream->frame_bytes > WAV_STREAM_TMP) {
+		printf("Error: WAV file with %d channels is not supported.\n", stream->header.Nch);
+		wav_closestream(stream);
+		return (PST_FAILURE);
+	}
+	stream->remain = stream->header.Nbyte / stream->frame_bytes;
+	return (PST_SUCCESS);
+}
+
+// reads up to num frames of interleaved samples into buf as 16bit
+// (num * Nch shorts); returns number of frames, 0 at the end
+int wav_readstream(WavStream *stream, short *buf, int num)
+{
+	u8 tmp[WAV_STREAM_TMP];
+	int nch = stream->header.Nch;
+	int k, n, done = 0;
+
+	if (num > stream->remain) num = stream->remain;
+	if (num <= 0) return 0;
+
+	if (stream->block_raw) {
+		done = wav_readadpcm(stream, buf, num);
+	} else if (stream->header.fmt_id == PCM_FORMAT_PCM && stream->header.bit == WAV_BITS) {
+		done = fread(buf, stream->frame_bytes, num, stream->fp);
+	} else {
+		// other formats go through a small buffer and the converters
+		while (done < num) {
+			k = sizeof(tmp) / stream->frame_bytes;
+			if (k > num - done) k = num - done;
+			if (k <= 0) break;
+			n = fread(tmp, stream->frame_bytes, k, stream->fp);
+			pcm_to_s16(tmp, stream->header.fmt_id, stream->header.bit, &buf[done * nch], n * nch);
+			done += n;
+			if (n < k) break;
+		}
+	}
+	stream->remain = (done < num)? 0: stream->remain - done;
+	return (done);
+}
+
+void wav_closestream(WavStream *stream)
+{
+	if (stream->fp) {
+		fclose(stream->fp);
+		stream->fp = 0;
+	}
+	if (stream->block_raw) free(stream->block_raw);
+	if (stream->block_pcm) free(stream->block_pcm);
+	stream->block_raw = 0;
+	stream->block_pcm = 0;
+	free_wavheader(&stream->header);
+}
+
+static void write2byte(FILE *fp, u16 data)
+{
+	u8 buf[2] = { data & 0xff, data >> 8 };
+	fwrite(buf, 1, 2, fp);
+}
+
+static void write4byte(FILE *fp, u32 data)
+{
+	u8 buf[4] = { data & 0xff, (data >> 8) & 0xff, (data >> 16) & 0xff, data >> 24 };
+	fwrite(buf, 1, 4, fp);
+}
+
+// writes I2S frames (L << 16 | R) as a 16bit stereo PCM file
+int wav_writefile(char *fn, const u32 *frames, int num, u32 fs)
+{
+	FILE *fp;
+	int i;
+
+	fp = fopen(fn, "wb");
+	if (!fp) {
+		printf("Error: Cannot create WAV file.\n");
+		return (PST_FAILURE);
+	}
+	fwrite("RIFF", 1, 4, fp);
+	write4byte(fp, 36 + num * 4);
+	fwrite("WAVE", 1, 4, fp);
+	fwrite("fmt ", 1, 4, fp);
+	write4byte(fp, 16);
+	write2byte(fp, 1);							// linear PCM
+	write2byte(fp, 2);							// stereo
+	write4byte(fp, fs);
+	write4byte(fp, fs * 4);
+	write2byte(fp, 4);
+	write2byte(fp, WAV_BITS);
+	fwrite("data", 1, 4, fp);
+	write4byte(fp, num * 4);
+	for (i = 0; i < num; i++) {
+		write2byte(fp, frames[i] >> 16);			// L
+		write2byte(fp, frames[i] & 0xffff);			// R
+	}
+	fclose(fp);
+	return (PST_SUCCESS);
+}
+
+static u16 le16(const u8 *p)
+{
+	return ((p[1] << 8) | p[0]);
+}
+
+static u32 le32(const u8 *p)
+{
+	return (((u32)p[3] << 24) | (p[2] << 16) | (p[1] << 8) | p[0]);
+}
+
+// maps a WAV file and points the view at its samples without a copy.
+// the pages are faulted in here, not later in the audio thread.
+// 16bit samples at an odd offset are copied once to be aligned
+int wav_mapfile(WavView *view, char *fn)
+{
+	struct stat st;
+	const u8 *p, *end;
+	const u8 *fmt = 0;
+	u32 size;
+	int fd;
+
+	memset(view, 0, sizeof(*view));
+	fd = open(fn, O_RDONLY);
+	if (fd < 0) {
+		printf("Error: Cannot open WAV file.\n");
+		return (PST_FAILURE);
+	}
+	if (fstat(fd, &st) < 0 || st.st_size < 12) {
+		close(fd);
+		printf("Error: WAV file is too short.\n");
+		return (PST_FAILURE);
+	}
+	view->map_size = st.st_size;
+	view->map = mmap(NULL, view->map_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+	close(fd);
+	if (view->map == MAP_FAILED) {
+		view->map = 0;
+		printf("Error: Cannot map WAV file.\n");
+		return (PST_FAILURE);
+	}
+
+	p   = (const u8 *)view->map;
+	end = p + view->map_size;
+	if (memcmp(p, "RIFF", 4) || memcmp(p + 8, "WAVE", 4)) {
+		printf("Error: Not a RIFF/WAVE file.\n");
+		wav_unmapfile(view);
+		return (PST_FAILURE);
+	}
+
+	// walk the chunk list; sizes are checked against the mapping
+	for (p += 12; p + 8 <= end; p += 8 + size + (size & 1)) {
+		size = le32(p + 4);
+		if (size > end - p - 8) size = end - p - 8;	// truncated file
+		if (!memcmp(p, "fmt ", 4) && size >= 16) {
+			fmt = p + 8;
+		} else if (!memcmp(p, "data", 4) && fmt) {
+			view->format   = le16(fmt);
+			view->channels = le16(fmt + 2);
+			view->rate     = le32(fmt + 4);
+			view->bits     = le16(fmt + 14);
+			view->block_align = le16(fmt + 12);
+			view->data     = p + 8;
+			view->bytes    = size;
+			if (view->format == 1 && view->bits == WAV_BITS && view->channels) {
+				view->frames = size / (view->channels * 2);
+				view->pcm    = (const int16_t *)(p + 8);
+				if ((p + 8 - (const u8 *)view->map) & 1) {
+					view->copy = malloc(size);
+					if (!view->copy) {
+						printf("Error: Cannot allocate WAV data.\n");
+						wav_unmapfile(view);
+						return (PST_FAILURE);
+					}
+					memcpy(view->copy, p + 8, size);
+					view->pcm = (const int16_t *)view->copy;
+				}
+			}
+			return (PST_SUCCESS);
+		}
+	}
+
+	printf("Error: fmt or data chunk not found.\n");
+	wav_unmapfile(view);
+	return (PST_FAILURE);
+}
+
+void wav_unmapfile(WavView *view)
+{
+	if (view->map) munmap(view->map, view->map_size);
+	free(view->copy);
+	memset(view, 0, sizeof(*view));
 }
 
 void free_wavheader(WavHeader *header)
@@ -76,6 +390,11 @@ void free_wavheader(WavHeader *header)
 		free(header->cbuf);
 		header->cbuf = 0;
 	}
+	if (header->map) {
+		munmap(header->map, header->map_size);
+		header->map  = 0;
+		header->data = 0;
+	}
 	if (header->data) {
 		free(header->data);
 		header->data = 0;
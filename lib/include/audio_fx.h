@@ -0,0 +1,69 @@
+/******************************************************
+ *    Filename:     audio_fx.h
+ *     Purpose:     Q15 effects chain (filter, echo, reverb)
+ *  Created on: 	2026/10/17
+ * Modified on:
+ *      Author: 	atsupi.com
+ *     Version:		0.90
+ ******************************************************/
+
+#ifndef _AUDIO_FX_H
+#define _AUDIO_FX_H
+
+#include "azplf_bsp.h"
+
+#define FX_BLOCK				256		// frames per kernel pass
+#define FX_RATE					48000
+#define FX_DELAY_MAX			FX_RATE	// longest echo, 1 sec
+
+// stages, processed in this order
+#define FX_HPF					0x01
+#define FX_LPF					0x02
+#define FX_ECHO					0x04
+#define FX_REVERB				0x08
+
+#define FX_COMB_NUM				4
+#define FX_ALLPASS_NUM			2
+
+// Q15 delay line
+typedef struct _FxDelay {
+	short *buf;
+	int len;
+	int pos;
+} FxDelay;
+
+// stereo effects chain of a bus; flags 0 or bypass costs nothing
+typedef struct _FxChain {
+	int flags;
+	int bypass;
+	// one-pole filters, state keeps 8 more fraction bits
+	short hpf_a;						// Q15
+	short lpf_a;
+	int hpf_z[2];
+	int lpf_z[2];
+	// feedback echo
+	short echo_fb;						// Q15
+	short echo_mix;
+	FxDelay echo[2];
+	// Schroeder reverb: parallel combs into series allpasses
+	short rev_fb;
+	short rev_mix;
+	FxDelay comb[2][FX_COMB_NUM];
+	FxDelay allpass[2][FX_ALLPASS_NUM];
+} FxChain;
+
+extern void fx_init(FxChain *fx);
+extern void fx_free(FxChain *fx);
+// clears the filter states and delay lines
+extern void fx_reset(FxChain *fx);
+// cutoff in Hz, 0 removes the stage
+extern void fx_set_hpf(FxChain *fx, int cutoff);
+extern void fx_set_lpf(FxChain *fx, int cutoff);
+// feedback and mix in percent; delay_ms 0 removes the stage
+extern int fx_set_echo(FxChain *fx, int delay_ms, int feedback, int mix);
+// room size and mix in percent; mix 0 removes the stage
+extern int fx_set_reverb(FxChain *fx, int room, int mix);
+// processes I2S frames (L << 16 | R) in place
+extern void fx_process(FxChain *fx, u32 *frames, int n);
+
+#endif //_AUDIO_FX_H
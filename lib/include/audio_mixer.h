@@ -0,0 +1,38 @@
+/******************************************************
+ *    Filename:     audio_mixer.h
+ *     Purpose:     multi-channel PCM mixer
+ *  Created on: 	2026/10/17
+ * Modified on:
+ *      Author: 	atsupi.com
+ *     Version:		0.90
+ ******************************************************/
+
+#ifndef _AUDIO_MIXER_H
+#define _AUDIO_MIXER_H
+
+#include "azplf_bsp.h"
+
+#define MIXER_MAX_CH			64		// inputs per mixer_mix call
+#define MIXER_GAIN_UNITY		256		// same scale as the vol_curve tables
+#define MIXER_GAIN_MAX			511
+#define MIXER_PAN_LEFT			-256
+#define MIXER_PAN_CENTER		0
+#define MIXER_PAN_RIGHT			256
+#define MIXER_VOL_NUM			16		// volume steps 0~15
+
+// one planar mono input
+typedef struct _MixerChannel {
+	const short *pcm;		// frames samples
+	int gain;				// 0~MIXER_GAIN_MAX
+	int pan;				// MIXER_PAN_LEFT~MIXER_PAN_RIGHT
+} MixerChannel;
+
+// mixes num channels into out as I2S frames (L << 16 | R), saturated.
+// full scale channels are summed without wrapping: all MIXER_MAX_CH at
+// gain MIXER_GAIN_UNITY or less, half as many at MIXER_GAIN_MAX.
+// gain for a volume step, the curve all players share
+extern const int mixer_vol_curve[MIXER_VOL_NUM];
+
+extern void mixer_mix(const MixerChannel *ch, int num, u32 *out, int frames);
+
+#endif //_AUDIO_MIXER_H
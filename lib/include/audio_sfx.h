@@ -0,0 +1,70 @@
+/******************************************************
+ *    Filename:     audio_sfx.h
+ *     Purpose:     sample-accurate sound effect scheduling
+ *  Created on: 	2026/10/17
+ * Modified on:
+ *      Author: 	atsupi.com
+ *     Version:		0.90
+ ******************************************************/
+
+#ifndef _AUDIO_SFX_H
+#define _AUDIO_SFX_H
+
+#include "azplf_bsp.h"
+#include "wav_util.h"
+
+#define SFX_CLIP_NUM			32		// pre-loaded clips
+#define SFX_VOICE_NUM			16		// clips playing or waiting at once
+#define SFX_QUEUE_SIZE			64		// commands, must be a power of 2
+#define SFX_MIX_BLOCK			256		// frames per mixer pass
+#define SFX_LOAD_BLOCK			512		// frames per read while loading
+#define SFX_ADPCM_FRAMES		2048	// largest IMA-ADPCM block kept compressed
+
+#define SFX_NOW					0		// at_sample: next frame written
+
+// mono clip at the codec rate, as 16bit samples or IMA-ADPCM blocks
+typedef struct _SfxClip {
+	const short *pcm;					// NULL for IMA-ADPCM
+	int len;							// frames, 0: free
+	short *heap;						// converted samples, NULL if used in place
+	const u8 *adpcm;					// blocks in the mapped file
+	u32 adpcm_bytes;
+	int block_bytes;
+	int block_frames;
+	WavView view;						// mapped file of a clip used in place
+} SfxClip;
+
+// game thread to audio thread; id < 0 stops every voice
+typedef struct _SfxCmd {
+	u64 at;
+	short id;
+	short gain;
+	short pan;
+} SfxCmd;
+
+typedef struct _SfxVoice {
+	const SfxClip *clip;				// NULL: free
+	int pos;							// 0 until the first frame is mixed
+	int block;							// IMA-ADPCM block decoded for the voice, -1: none
+	u64 at;
+	short gain;
+	short pan;
+} SfxVoice;
+
+typedef struct _SfxStats {
+	u32 played;
+	u32 late;							// started after at_sample
+	u32 dropped;						// queue or voices full
+} SfxStats;
+
+// game side: load before playing, unload after the audio thread stops
+extern int sfx_load(char *fn);
+extern void sfx_unload_all(void);
+extern int sfx_play(int id, u64 at_sample, int gain, int pan);
+extern void sfx_stop_all(void);
+extern void sfx_get_stats(SfxStats *stats);
+// audio thread side
+extern int sfx_pending(u64 until);
+extern void sfx_mix(u32 *frames, int n, u64 pos);
+
+#endif //_AUDIO_SFX_H
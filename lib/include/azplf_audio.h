@@ -10,13 +10,74 @@
 #ifndef _AZPLF_AUDIO_H
 #define _AZPLF_AUDIO_H
 
+#include <stddef.h>
 #include "azplf_bsp.h"
 #include "azplf_hal.h"
 #include "wav_util.h"
 #include "psg_util.h"
+#include "audio_mixer.h"
+#include "resampler.h"
+#include "pcm_convert.h"
+#include "audio_fx.h"
+#include "audio_sfx.h"
 
 #define REG_I2S_OUT(offset)		(*(volatile unsigned int *)(pReg_i2s_drv + (offset)))
 
+#define AUDIO_SAMPLE_RATE		48000	// SSM2603 R8
+#define AUDIO_RESAMPLE_MODE		RESAMPLE_SINC
+
+// audio thread
+#define AUDIO_RING_SIZE			16384	// frames, must be a power of 2
+#define AUDIO_BLOCK_SIZE		256		// frames the audio thread waits for
+#define AUDIO_POLL_US			250		// 12 frames at 48kHz
+#define AUDIO_WAIT_US			20000	// FIFO wait timeout
+#define AUDIO_STREAM_BLOCK		1024	// frames per read from a WAV stream
+#define AUDIO_THREAD_PRIORITY	80		// SCHED_FIFO
+
+// effects buses
+#define AUDIO_BUS_MUSIC			0		// PSG
+#define AUDIO_BUS_WAV			1		// WAV files and streams
+#define AUDIO_BUS_NUM			2
+
+// sound effects start exactly when scheduled this far ahead of the clock
+#define AUDIO_SFX_LEAD			(I2SOUT_FIFO_DEPTH + AUDIO_BLOCK_SIZE)
+
+// latency control
+#define AUDIO_LATENCY_DEF		2400	// frames queued ahead of the codec (50ms)
+#define AUDIO_LATENCY_MIN		(I2SOUT_FIFO_DEPTH + AUDIO_BLOCK_SIZE)
+#define AUDIO_LATENCY_MAX		AUDIO_RING_SIZE
+#define AUDIO_LATENCY_MARGIN	AUDIO_BLOCK_SIZE	// slack left at the lowest point
+#define AUDIO_ADAPT_FRAMES		(AUDIO_SAMPLE_RATE * 5)	// window to lower the target
+
+// instrumentation
+#define AUDIO_TICK_FRAMES		800		// frames needed per 1/60 sec
+#define AUDIO_STATS_BINS		16		// AUDIO_RING_SIZE / 16 frames per bin
+
+typedef struct _AudioStats {
+	u32 fill_hist[AUDIO_STATS_BINS];	// ring fill sampled at each write
+	u32 writes;
+	u64 frames;							// frames written
+	u32 underruns;
+	u32 fifo_full;						// I2S FIFO found full by a writer
+	u64 wait_ns;						// blocked on the I2S FIFO
+	u64 ring_wait_ns;					// producers blocked on a full ring
+	u32 ticks;
+	u32 tick_short;						// ticks with less than AUDIO_TICK_FRAMES
+	int tick_frames_min;
+	int tick_frames_max;
+} AudioStats;
+
+// sample clock against the CPU clock
+typedef struct _AudioSync {
+	u64 clock;							// frames played by the codec
+	u64 wall;							// frames counted by the CPU clock
+	int drift_ppm;						// codec against CPU clock
+	int latency;						// frames queued ahead of the clock (FIFO + ring)
+	int adjust_max;						// largest correction at a FIFO full, frames
+	int target;							// latency target
+	int slack;							// lowest latency before a refill in the last window
+} AudioSync;
+
 extern void azplf_audio_init(void);
 extern void azplf_audio_deinit(void);
 extern void azplf_audio_set_volume(int value);
@@ -25,6 +86,33 @@ extern void azplf_audio_initSSM2603(void);
 extern void azplf_audio_free_wav(WavHeader *wav);
 extern int azplf_audio_load_wav(char *fn, WavHeader *wav);
 extern void PlayWavFile(char *fn);
+extern int azplf_audio_play_stream(char *fn);
+extern void azplf_audio_stop_stream(void);
+extern int azplf_audio_stream_playing(void);
+
+extern int azplf_audio_start_thread(void);
+extern void azplf_audio_stop_thread(void);
+extern int azplf_audio_write(const u32 *frames, int n);
+extern int azplf_audio_get_fill(void);
+extern u32 azplf_audio_get_underruns(void);
+extern void azplf_audio_get_stats(AudioStats *stats);
+extern void azplf_audio_reset_stats(void);
+extern void azplf_audio_dump_stats(void);
+extern void azplf_audio_set_stats_dump(int interval_sec);
+extern void azplf_audio_stats_tick(u32 system_time);
+extern u64 azplf_audio_get_clock(void);
+extern u32 azplf_audio_clock_to_tick(u64 frames);
+extern u64 azplf_audio_tick_to_clock(u32 tick);
+extern void azplf_audio_get_sync(AudioSync *sync);
+extern void azplf_audio_set_latency(int frames);
+extern int azplf_audio_get_latency(void);
+extern int azplf_audio_get_request(void);
+extern void azplf_audio_process_fx(int bus, u32 *frames, int n);
+extern void azplf_audio_set_hpf(int bus, int cutoff);
+extern void azplf_audio_set_lpf(int bus, int cutoff);
+extern int azplf_audio_set_echo(int bus, int delay_ms, int feedback, int mix);
+extern int azplf_audio_set_reverb(int bus, int room, int mix);
+extern void azplf_audio_bypass_fx(int bus, int bypass);
 
 extern u8 i2c_read1byte(u8 address);
 extern void i2c_write1byte(u8 address, u8 data);
@@ -35,6 +123,8 @@ extern void i2sout_init(void);
 extern void i2sout_deinit(void);
 extern void i2sout_senddata(u32 address, u32 data);
 extern u32 i2sout_getstatus(u32 address);
+extern int i2sout_wait_space(int n, int timeout_us);
+extern size_t i2sout_write_block(const u32 *frames, size_t n);
 
 
 #endif //_AZPLF_AUDIO_H
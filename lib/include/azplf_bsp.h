@@ -30,6 +30,8 @@
 
 #define Use_I2Sout
 #define I2SOUT_BASEADDR					0x43C00000
+#define I2SOUT_UIO_NAME					"i2s-out"	// UIO device of the FIFO half-empty interrupt
+#define I2SOUT_FIFO_DEPTH				1024		// frames
 #define SSM2603_IIC_ADDRESS				0x1A
 
 // platform status result
@@ -38,7 +40,7 @@
 #define PST_VDMA_MISMATCH_ERROR			(2)
 
 // display parameters 
-#ifdef (Use_LQ070out)
+#ifdef Use_LQ070out
 #define DISP_WIDTH						800
 #define DISP_HEIGHT						480
 #else
@@ -59,6 +61,7 @@
 typedef unsigned char  u8;
 typedef unsigned short u16;
 typedef unsigned int   u32;
+typedef unsigned long long u64;
 
 typedef struct _pos {
 	int x;
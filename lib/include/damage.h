@@ -0,0 +1,35 @@
+/******************************************************
+ *    Filename:     damage.h
+ *     Purpose:     dirty rectangles of a frame buffer
+ *  Created on: 	2026/10/17
+ * Modified on:
+ *      Author: 	atsupi.com
+ *     Version:		0.90
+ ******************************************************/
+
+#ifndef DAMAGE_H_
+#define DAMAGE_H_
+
+#include "azplf_bsp.h"
+
+#define DAMAGE_RECT_MAX				16
+
+// corners are inclusive, as for gfxaccel_fill_rect
+typedef struct _DamageRect {
+	u16 x1, y1, x2, y2;
+} DamageRect;
+
+// area of one frame buffer drawn over since the last damage_clear
+typedef struct _DamageRegion {
+	u32 fb;									// physical address
+	int num;
+	DamageRect rects[DAMAGE_RECT_MAX];
+} DamageRegion;
+
+extern void damage_init(DamageRegion *dmg, u32 fb);
+extern void damage_clear(DamageRegion *dmg);
+extern void damage_add(DamageRegion *dmg, int x1, int y1, int x2, int y2);
+extern void damage_add_all(DamageRegion *dmg);
+extern u32 damage_area(const DamageRegion *dmg);
+
+#endif // DAMAGE_H_
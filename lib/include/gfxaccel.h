@@ -10,18 +10,32 @@
 #ifndef GFXACCEL_H_
 #define GFXACCEL_H_
 
+#include <pthread.h>
+#include <semaphore.h>
+#include "damage.h"
+
 #define GFXACCEL_BASE_ADDR			XPAR_XGFXACCEL_0_BASEADDR
 
 // Definition for Gfxaccel IP
 #define GFXACCEL_MODE_FILLRECT		1
 #define GFXACCEL_MODE_LINE			2
 #define GFXACCEL_MODE_BITBLT		3
+#define GFXACCEL_MODE_LIST			0x80	// driver only: replays a display list
 
 #define GFXACCEL_BB_NONE			0
 #define GFXACCEL_BB_OR				1
 #define GFXACCEL_BB_AND				2
 #define GFXACCEL_BB_XOR				3
 
+// backends, selected by the init function
+#define GFXACCEL_BACKEND_HW			0		// gfxaccel_init: the IP in the FPGA
+#define GFXACCEL_BACKEND_SOFT		1		// gfxaccel_init_soft: host memory
+
+// command queue
+#define GFXACCEL_QUEUE_SIZE			1024	// commands, must be a power of 2
+#define GFXACCEL_POLL_US			50		// wait for a fence or queue space
+#define GFXACCEL_LIST_GROW			64		// commands added to a full list
+
 /* Graphics Accelerator HW IP
 -- ------------------------Address Info-------------------
 -- 0x00 : Control signals
@@ -71,14 +85,95 @@
 #define GFXACCEL_CONTROL_ADDR_MODE_DATA   0x58
 #define GFXACCEL_CONTROL_ADDR_OP_DATA     0x60
 
+// argument registers kept in the shadow copy
+#define GFXACCEL_ARG_SRC_FB			0
+#define GFXACCEL_ARG_X1				1
+#define GFXACCEL_ARG_Y1				2
+#define GFXACCEL_ARG_DX				3
+#define GFXACCEL_ARG_DY				4
+#define GFXACCEL_ARG_DST_FB			5
+#define GFXACCEL_ARG_X2				6
+#define GFXACCEL_ARG_Y2				7
+#define GFXACCEL_ARG_COL			8
+#define GFXACCEL_ARG_MODE			9
+#define GFXACCEL_ARG_OP				10
+#define GFXACCEL_ARG_NUM			11
+
+struct _GfxaccelList;
+
+// one operation of the IP, as written to its argument registers
+typedef struct _GfxaccelCmd {
+	u32 src_fb;
+	u32 dst_fb;
+	u32 col;
+	u16 x1, y1, dx, dy, x2, y2;
+	u8 mode;
+	u8 op;
+	struct _GfxaccelList *list;				// GFXACCEL_MODE_LIST
+} GfxaccelCmd;
+
+// commands submitted before it have completed once it is done
+typedef u32 GfxaccelFence;
+
+typedef struct _GfxaccelStats {
+	u32 cmds;								// operations run by the IP
+	u32 queue_full;							// submits that waited for queue space
+	u64 fence_wait_ns;						// blocked in gfxaccel_wait_fence
+	u64 reg_writes;							// argument registers written
+	u64 reg_elided;							// skipped, the IP already held the value
+	u64 pixels;								// drawn by the operations
+} GfxaccelStats;
+
+// the stats are counted by both the drawing thread and the submit
+// thread, without a lock; the u64 fields must not tear on 32bit ARM
+#define GFXACCEL_STAT_ADD(stats, field, value)	__atomic_fetch_add(&(stats)->field, (value), __ATOMIC_RELAXED)
+#define GFXACCEL_STAT_GET(stats, field)			__atomic_load_n(&(stats)->field, __ATOMIC_RELAXED)
+
+typedef struct _GfxaccelListStats {
+	u32 replays;
+	u64 submit_ns;							// CPU time to replay
+	u64 run_ns;								// IP time, first command to idle
+	u32 run_ns_max;
+} GfxaccelListStats;
+
+// commands recorded once (validated then) and replayed as one queue entry
+typedef struct _GfxaccelList {
+	GfxaccelCmd *cmds;
+	int num;
+	int size;
+	GfxaccelFence fence;					// of the last replay
+	GfxaccelListStats stats;
+} GfxaccelList;
+
 // instance definition
 typedef struct _GfxaccelInstance {
 	u32 baseAddress;						// physical address
 	u32 virtAddress;						// virtual address
+	int backend;
+	u32 *soft_mem;							// GFXACCEL_BACKEND_SOFT: from baseAddress
+	u32 soft_size;							// bytes
+	// command queue: single producer (the drawing thread) / submitter thread
+	GfxaccelCmd *queue;
+	u32 head;								// commands submitted
+	u32 tail;								// commands taken by the submitter
+	u32 done;								// commands completed
+	int running;
+	int quit;
+	pthread_t thread;
+	sem_t work;
+	GfxaccelList *recording;				// gfxaccel_list_begin
+	DamageRegion *damage;					// gfxaccel_track_damage
+	// values written to the argument registers, used by the IP thread
+	u32 shadow[GFXACCEL_ARG_NUM];
+	u32 shadow_valid;						// bit per GFXACCEL_ARG_*
+	GfxaccelStats stats;
 } GfxaccelInstance;
 
 // external functions
 extern u32 gfxaccel_init(GfxaccelInstance *inst, u32 baseAddr);
+extern u32 gfxaccel_init_soft(GfxaccelInstance *inst, u32 baseAddr, u32 size);
+extern u32 *gfxaccel_get_fb(GfxaccelInstance *inst, u32 fb);
+extern void gfxaccel_soft_run(GfxaccelInstance *inst, const GfxaccelCmd *cmd);
 extern void gfxaccel_deinit(GfxaccelInstance *inst);
 extern void gfxaccel_start(GfxaccelInstance *inst);
 extern void gfxaccel_stop(GfxaccelInstance *inst);
@@ -88,5 +183,26 @@ extern void gfxaccel_fill_rect(GfxaccelInstance *inst, u32 fb, u16 x1, u16 y1, u
 extern void gfxaccel_draw_line(GfxaccelInstance *inst, u32 fb, u16 x1, u16 y1, u16 x2, u16 y2, u32 col);
 extern void gfxaccel_bitblt(GfxaccelInstance *inst, u32 src_fb, u16 x1, u16 y1, u16 dx, u16 dy, u32 dst_fb, u16 x2, u16 y2, u8 op);
 
+extern int gfxaccel_start_queue(GfxaccelInstance *inst);
+extern void gfxaccel_stop_queue(GfxaccelInstance *inst);
+extern void gfxaccel_submit(GfxaccelInstance *inst, const GfxaccelCmd *cmd);
+extern void gfxaccel_submit_fill_rect(GfxaccelInstance *inst, u32 fb, u16 x1, u16 y1, u16 x2, u16 y2, u32 col);
+extern void gfxaccel_submit_draw_line(GfxaccelInstance *inst, u32 fb, u16 x1, u16 y1, u16 x2, u16 y2, u32 col);
+extern void gfxaccel_submit_bitblt(GfxaccelInstance *inst, u32 src_fb, u16 x1, u16 y1, u16 dx, u16 dy, u32 dst_fb, u16 x2, u16 y2, u8 op);
+extern GfxaccelFence gfxaccel_fence(GfxaccelInstance *inst);
+extern int gfxaccel_fence_done(GfxaccelInstance *inst, GfxaccelFence fence);
+extern void gfxaccel_wait_fence(GfxaccelInstance *inst, GfxaccelFence fence);
+extern void gfxaccel_finish(GfxaccelInstance *inst);
+extern void gfxaccel_get_stats(GfxaccelInstance *inst, GfxaccelStats *stats);
+extern void gfxaccel_track_damage(GfxaccelInstance *inst, DamageRegion *dmg);
+
+extern void gfxaccel_list_init(GfxaccelList *list);
+extern void gfxaccel_list_free(GfxaccelInstance *inst, GfxaccelList *list);
+extern void gfxaccel_list_reset(GfxaccelInstance *inst, GfxaccelList *list);
+extern void gfxaccel_list_begin(GfxaccelInstance *inst, GfxaccelList *list);
+extern void gfxaccel_list_end(GfxaccelInstance *inst);
+extern void gfxaccel_list_replay(GfxaccelInstance *inst, GfxaccelList *list);
+extern void gfxaccel_list_get_stats(GfxaccelList *list, GfxaccelListStats *stats);
+
 
 #endif // GFXACCEL_H_
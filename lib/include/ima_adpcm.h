@@ -0,0 +1,28 @@
+/******************************************************
+ *    Filename:     ima_adpcm.h
+ *     Purpose:     IMA-ADPCM (WAV format 0x11) decoder
+ *  Created on: 	2026/10/17
+ * Modified on:
+ *      Author: 	atsupi.com
+ *     Version:		0.90
+ ******************************************************/
+
+#ifndef _IMA_ADPCM_H
+#define _IMA_ADPCM_H
+
+#include "azplf_bsp.h"
+
+#define WAV_FORMAT_IMA_ADPCM	0x11
+
+// frames in a block of block_bytes for nch channels
+#define IMA_BLOCK_FRAMES(block_bytes, nch) \
+	((((block_bytes) - 4 * (nch)) / (4 * (nch))) * 8 + 1)
+
+// decodes channel ch of a block; samples are stored step shorts apart,
+// so out can be a planar mixer input (step 1) or interleaved (step nch).
+// returns number of samples
+extern int ima_decode_channel(const u8 *block, int block_bytes, int nch, int ch, short *out, int step);
+// decodes all channels of a block interleaved, returns number of frames
+extern int ima_decode_block(const u8 *block, int block_bytes, int nch, short *out);
+
+#endif //_IMA_ADPCM_H
@@ -0,0 +1,37 @@
+/******************************************************
+ *    Filename:     pcm_convert.h
+ *     Purpose:     PCM sample format converters
+ *  Created on: 	2026/10/17
+ * Modified on:
+ *      Author: 	atsupi.com
+ *     Version:		0.90
+ ******************************************************/
+
+#ifndef _PCM_CONVERT_H
+#define _PCM_CONVERT_H
+
+#include <stdint.h>
+#include "azplf_bsp.h"
+
+// WAV fmt_id
+#define PCM_FORMAT_PCM			1
+#define PCM_FORMAT_FLOAT		3
+
+// to signed 16bit; n is the number of samples
+extern void pcm_u8_to_s16(const u8 *in, short *out, int n);
+extern void pcm_s24_to_s16(const u8 *in, short *out, int n);		// packed little endian
+extern void pcm_s32_to_s16(const int32_t *in, short *out, int n);
+extern void pcm_f32_to_s16(const float *in, short *out, int n);		// -1.0~1.0, saturated
+
+// channel layout; n is the number of frames
+extern void pcm_mono_to_stereo(const short *in, short *out, int n);
+extern void pcm_stereo_to_mono(const short *in, short *out, int n);
+extern void pcm_deinterleave(const short *in, int nch, short *l, short *r, int n);
+
+// bits per sample the converters accept for the WAV format, 0 if none
+extern int pcm_supported(int format, int bits);
+// converts n samples of a WAV format to signed 16bit.
+// out may overlap in only when the samples do not get wider (not 8bit)
+extern int pcm_to_s16(const void *in, int format, int bits, short *out, int n);
+
+#endif //_PCM_CONVERT_H
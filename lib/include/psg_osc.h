@@ -0,0 +1,81 @@
+/******************************************************
+ *    Filename:     psg_osc.h
+ *     Purpose:     PSG fixed-point oscillator core
+ *  Created on: 	2026/10/17
+ * Modified on:
+ *      Author: 	atsupi.com
+ *     Version:		0.90
+ ******************************************************/
+
+#ifndef _PSG_OSC_H
+#define _PSG_OSC_H
+
+#include "azplf_bsp.h"
+
+#define PSG_SAMPLE_RATE			48000
+#define PSG_PERIOD_SHIFT		16		// fractional bits of a period (Q16 samples)
+
+// One oscillator cycle is the full 32-bit phase range.
+// inc and duty are computed at note-on (or when the pitch is bent),
+// so the per-sample work is an add and a compare/lookup.
+typedef struct _PsgOsc {
+	u32 phase;			// current phase (2^32 = 1 cycle)
+	u32 inc;			// phase increment per sample
+	u32 duty;			// pulse output is high while phase >= duty
+} PsgOsc;
+
+// period: Q16 number of samples per cycle, 0 means no tone
+static inline u32 psg_osc_inc_from_period(u32 period)
+{
+	if (period < (1 << PSG_PERIOD_SHIFT))
+		return (0);
+	return ((u32)((1ULL << (32 + PSG_PERIOD_SHIFT)) / period));
+}
+
+// pwm_rate: high part of the pulse in percent (1~99)
+static inline u32 psg_osc_duty_from_pwm(int pwm_rate)
+{
+	if (pwm_rate <= 0)
+		return (0xFFFFFFFF);
+	if (pwm_rate >= 100)
+		return (0);
+	return ((u32)(((u64)(100 - pwm_rate) << 32) / 100));
+}
+
+// gain: 0~65536 (1.0 = 65536)
+static inline void psg_osc_render_pulse(PsgOsc *osc, short *out, int n, int gain)
+{
+	u32 phase = osc->phase;
+	u32 inc   = osc->inc;
+	u32 duty  = osc->duty;
+	short high = (short)((0x7FFF * gain) >> 16);
+	int i;
+
+	for (i = 0; i < n; i++) {
+		out[i] = (phase < duty)? 0: high;
+		phase += inc;
+	}
+	osc->phase = phase;
+}
+
+// tbl: 256 entry wave table, indexed by the upper 8 bits of the phase
+static inline void psg_osc_render_table(PsgOsc *osc, const char *tbl, short *out, int n, int gain)
+{
+	u32 phase = osc->phase;
+	u32 inc   = osc->inc;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		out[i] = (short)(((tbl[phase >> 24] << 8) * gain) >> 16);
+		phase += inc;
+	}
+	osc->phase = phase;
+}
+
+// advance the phase without output (gated part of a note)
+static inline void psg_osc_skip(PsgOsc *osc, int n)
+{
+	osc->phase += osc->inc * (u32)n;
+}
+
+#endif //_PSG_OSC_H
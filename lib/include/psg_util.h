@@ -10,14 +10,55 @@
 #ifndef _PSG_UTIL_H
 #define _PSG_UTIL_H
 
+#include <stddef.h>
 #include "azplf_bsp.h"
 #include "azplf_hal.h"
 
 #define CH_NUM				4
-#define MAX_MML_LEN			512
+#define PSG_FRAME_SIZE		1200	// frames per slice
+
+#ifndef PSG_VOICE_NUM
+#define PSG_VOICE_NUM		16		// voices shared by music and sound effects
+#endif
+// every pool voice, music or sound effect, is mixed at the same fixed gain
+// MIXER_GAIN_UNITY / PSG_MIX_HEADROOM, so this many full scale voices sum to
+// full scale: the 4 music channels plus 4 sound effects never clip. Beyond
+// that the mixer saturates; the volume curve keeps voices well below full
+// scale at the usual volume settings.
+#ifndef PSG_MIX_HEADROOM
+#define PSG_MIX_HEADROOM	8
+#endif
+#define PSG_SFX_NUM			32
+#define PSG_PRIO_MUSIC		128		// sound effects above this steal music voices
+#define PSG_MACRO_NUM		26		// $A~$Z
+#define PSG_PATTERN_NUM		64		// compiled macros shared by all channels
+#define PSG_NEST_MAX		4		// loops and macro calls
+#ifndef PSG_CACHE_BUDGET
+#define PSG_CACHE_BUDGET	0		// bytes for loop render caches, 0: off
+#endif
+
+// synthesis cost of PsgRenderSlice
+typedef struct _PsgStats {
+	u32 slices;
+	u64 synth_ns;
+	u32 synth_ns_max;
+	int voices_max;
+	u32 cached;			// track slices played from the loop render cache
+} PsgStats;
 
 extern void PlayMusicSlice(int debug_mode);
+extern int PsgRenderSlice(u32 *frames);
+extern int PsgRenderMusic(u32 *frames, int max_frames, int until_loop);
+extern int PsgGetLoopCount(void);
 extern void AttachMMLData(int ch, char *data);
 extern int LoadMMLData(char *fn);
+extern int PsgDefineMacro(char name, char *data);
+extern int PsgLoadSfx(char *data);
+extern int PsgPlaySfx(int id, int priority, int pan);
+extern void PsgStopVoice(int handle);
+extern int PsgGetActiveVoices(void);
+extern void PsgGetStats(PsgStats *stats);
+extern void PsgResetStats(void);
+extern void PsgSetRenderCache(size_t budget);
 
 #endif //_PSG_UTIL_H
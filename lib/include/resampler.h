@@ -0,0 +1,42 @@
+/******************************************************
+ *    Filename:     resampler.h
+ *     Purpose:     sample rate converter
+ *  Created on: 	2026/10/17
+ * Modified on:
+ *      Author: 	atsupi.com
+ *     Version:		0.90
+ ******************************************************/
+
+#ifndef _RESAMPLER_H
+#define _RESAMPLER_H
+
+#include "azplf_bsp.h"
+
+#define RESAMPLE_LINEAR			0
+#define RESAMPLE_SINC			1		// polyphase windowed-sinc
+
+#define RESAMPLE_TAPS			16
+#define RESAMPLE_PHASE_BITS		6
+#define RESAMPLE_PHASES			(1 << RESAMPLE_PHASE_BITS)
+#define RESAMPLE_CHUNK			512		// input samples buffered per step
+
+// one mono channel; the state carries over between blocks
+typedef struct _Resampler {
+	int mode;
+	int taps;				// 2 (linear) or RESAMPLE_TAPS
+	u32 step;				// Q16 input samples per output sample
+	u32 pos;				// Q16 read position in buf
+	int fill;				// samples in buf
+	short buf[RESAMPLE_TAPS + RESAMPLE_CHUNK];
+	short coef[RESAMPLE_PHASES][RESAMPLE_TAPS];		// Q15
+} Resampler;
+
+// upper bound of output samples for n input samples
+#define RESAMPLE_MAX_OUT(rs, n)	((int)(((u64)(n) << 16) / (rs)->step) + 2)
+
+extern void resampler_init(Resampler *rs, u32 in_rate, u32 out_rate, int mode);
+extern void resampler_reset(Resampler *rs);
+// converts n input samples, returns number of output samples
+extern int resampler_process(Resampler *rs, const short *in, int n, short *out, int max_out);
+
+#endif //_RESAMPLER_H
@@ -10,6 +10,9 @@
 #ifndef WAV_UTIL_H_
 #define WAV_UTIL_H_
 
+#include <stdio.h>
+#include <stdint.h>
+
 static int WAV_BITS = 16;
 
 typedef struct {
@@ -29,9 +32,48 @@ typedef struct {
 	u8		data_chnk[4];
 	u32		Nbyte;
 	short	*data;
+	void	*map;					// data points into this mapping (read only)
+	size_t	map_size;
 } WavHeader;
 
+// WAV file read block by block
+typedef struct {
+	FILE	*fp;
+	WavHeader header;
+	int		remain;					// frames left in the data chunk
+	int		frame_bytes;
+	u8		*block_raw;				// IMA-ADPCM block being decoded
+	short	*block_pcm;
+	int		block_frames;
+	int		block_pos;
+	int		block_len;
+} WavStream;
+
+#define WAV_STREAM_TMP		4096	// bytes converted at once
+
+// samples of a memory mapped WAV file
+typedef struct {
+	const int16_t *pcm;				// interleaved, NULL unless 16bit linear PCM
+	u32		frames;
+	u16		channels;
+	u32		rate;
+	u16		bits;
+	u16		format;					// fmt_id
+	u16		block_align;			// bytes per IMA-ADPCM block
+	const u8 *data;					// data chunk as is
+	u32		bytes;
+	void	*map;
+	size_t	map_size;
+	void	*copy;					// aligned copy of pcm, the data chunk was at an odd offset
+} WavView;
+
 extern int wav_readfile(WavHeader *header, char *fn);
 extern void free_wavheader(WavHeader *header);
+extern int wav_writefile(char *fn, const u32 *frames, int num, u32 fs);
+extern int wav_openstream(WavStream *stream, char *fn);
+extern int wav_readstream(WavStream *stream, short *buf, int num);
+extern void wav_closestream(WavStream *stream);
+extern int wav_mapfile(WavView *view, char *fn);
+extern void wav_unmapfile(WavView *view);
 
 #endif //WAV_UTIL_H_
@@ -0,0 +1,435 @@
+/******************************************************
+ *    Filename:     audio_bench.c
+ *     Purpose:     host-side benchmark for audio kernels
+ *  Target Plf:     Linux host / ZYBO (azplf)
+ *  Created on: 	2026/10/17
+ * Modified on:
+ *      Author: 	atsupi.com
+ *     Version:		0.90
+ ******************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include "azplf_bsp.h"
+#include "psg_osc.h"
+#include "audio_mixer.h"
+#include "resampler.h"
+#include "pcm_convert.h"
+#include "ima_adpcm.h"
+#include "audio_fx.h"
+
+#define BENCH_CH_NUM		4
+#define BENCH_FRAME_SIZE	1200		// same as PSG_FRAME_SIZE
+#define BENCH_LOOPS			2000
+
+static char tone_tbl[256];
+static short out[BENCH_CH_NUM][BENCH_FRAME_SIZE];
+static volatile int sink;
+
+static double now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ts.tv_sec * 1e9 + ts.tv_nsec);
+}
+
+static void report(const char *name, double ns, long samples)
+{
+	printf("  %-28s %8.2f ns/sample\n", name, ns / samples);
+}
+
+/******************************************************
+ * PSG generators before the fixed-point rework
+ ******************************************************/
+
+typedef struct _LegacyCh {
+	int fr_value;
+	int fr_tune;
+	int fr_counter;
+	int len;
+	int slice_pos;
+	int tone_rate;
+	int pwm_rate;
+} LegacyCh;
+
+static float vol_curve_f[] = {
+	 0,  1,   4,   9,  16,  25,  36,  49,  64, 81, 100, 121, 144, 169, 204, 256.0
+};
+
+static short LegacyTableToneWave(LegacyCh *inst)
+{
+	int freq_value = inst->fr_value + inst->fr_tune;
+	float int_pos = 256 * inst->fr_counter / freq_value;
+	short data;
+
+	data = tone_tbl[(int)(int_pos)] << 8;
+
+	if (++inst->fr_counter >= freq_value) inst->fr_counter = 0;
+	return (data);
+}
+
+static short LegacyPsgWave(LegacyCh *inst)
+{
+	short data;
+	float tone_dur = inst->len * inst->tone_rate / 8;
+	float pwm_dur;
+	int freq_value = inst->fr_value + inst->fr_tune;
+
+	if ((int)tone_dur < inst->slice_pos) {
+		data = 0x0;
+	} else {
+		pwm_dur = (freq_value) * (100 - inst->pwm_rate) / 100;
+		if (inst->fr_counter < (int)pwm_dur)
+			data = 0x0;
+		else
+			data = 0x7FFF;
+	}
+
+	if (++inst->fr_counter >= freq_value) inst->fr_counter = 0;
+
+	return (data);
+}
+
+static void bench_legacy(int table)
+{
+	LegacyCh ch[BENCH_CH_NUM];
+	float data;
+	double t0, t1;
+	int i, j, k;
+
+	for (j = 0; j < BENCH_CH_NUM; j++) {
+		memset(&ch[j], 0, sizeof(ch[j]));
+		ch[j].fr_value  = (int)(48000.0 / (261.6 * (j + 1)));
+		ch[j].len       = 24000;
+		ch[j].tone_rate = 6;
+		ch[j].pwm_rate  = 25;
+	}
+
+	t0 = now_ns();
+	for (k = 0; k < BENCH_LOOPS; k++) {
+		for (j = 0; j < BENCH_CH_NUM; j++) {
+			for (i = 0; i < BENCH_FRAME_SIZE; i++) {
+				data = table? LegacyTableToneWave(&ch[j]): LegacyPsgWave(&ch[j]);
+				data *= vol_curve_f[12] / 256 * vol_curve_f[10] / 256;
+				out[j][i] = (short)data;
+				if (++ch[j].slice_pos >= ch[j].len) ch[j].slice_pos = 0;
+			}
+		}
+		sink += out[0][k % BENCH_FRAME_SIZE];
+	}
+	t1 = now_ns();
+	report(table? "table tone (before)": "pulse (before)", t1 - t0,
+		(long)BENCH_LOOPS * BENCH_CH_NUM * BENCH_FRAME_SIZE);
+}
+
+static void bench_osc(int table)
+{
+	PsgOsc osc[BENCH_CH_NUM];
+	int gain = 144 * 100;
+	double t0, t1;
+	int j, k;
+
+	for (j = 0; j < BENCH_CH_NUM; j++) {
+		osc[j].phase = 0;
+		osc[j].inc   = psg_osc_inc_from_period((u32)(PSG_SAMPLE_RATE * 65536.0 / (261.6 * (j + 1))));
+		osc[j].duty  = psg_osc_duty_from_pwm(25);
+	}
+
+	t0 = now_ns();
+	for (k = 0; k < BENCH_LOOPS; k++) {
+		for (j = 0; j < BENCH_CH_NUM; j++) {
+			if (table)
+				psg_osc_render_table(&osc[j], tone_tbl, out[j], BENCH_FRAME_SIZE, gain);
+			else
+				psg_osc_render_pulse(&osc[j], out[j], BENCH_FRAME_SIZE, gain);
+		}
+		sink += out[0][k % BENCH_FRAME_SIZE];
+	}
+	t1 = now_ns();
+	report(table? "table tone (phase acc)": "pulse (phase acc)", t1 - t0,
+		(long)BENCH_LOOPS * BENCH_CH_NUM * BENCH_FRAME_SIZE);
+}
+
+static void bench_psg(void)
+{
+	int i;
+
+	for (i = 0; i < 256; i++)
+		tone_tbl[i] = (char)(sin(2 * M_PI * i / 256) * 127);
+
+	printf("PSG oscillators (%d ch x %d samples x %d loops)\n",
+		BENCH_CH_NUM, BENCH_FRAME_SIZE, BENCH_LOOPS);
+	bench_legacy(0);
+	bench_osc(0);
+	bench_legacy(1);
+	bench_osc(1);
+}
+
+/******************************************************
+ * 4 channel mix into I2S frames
+ ******************************************************/
+
+static void bench_mixer(void)
+{
+	static u32 packed[BENCH_CH_NUM][BENCH_FRAME_SIZE];
+	static u32 frames[BENCH_FRAME_SIZE];
+	MixerChannel mix[BENCH_CH_NUM];
+	u32 l_pcm, r_pcm;
+	double t0, t1;
+	int i, j, k;
+
+	for (j = 0; j < BENCH_CH_NUM; j++) {
+		for (i = 0; i < BENCH_FRAME_SIZE; i++) {
+			out[j][i] = (short)(rand() & 0xFFFF);
+			packed[j][i] = ((u16)out[j][i] << 16) | (u16)out[j][i];
+		}
+		mix[j].pcm  = out[j];
+		mix[j].gain = MIXER_GAIN_UNITY / BENCH_CH_NUM;
+		mix[j].pan  = MIXER_PAN_CENTER;
+	}
+
+	printf("Mixer (%d ch x %d frames x %d loops)\n",
+		BENCH_CH_NUM, BENCH_FRAME_SIZE, BENCH_LOOPS);
+
+	// unpack/sum/divide loop of the old PlayMusicSlice
+	t0 = now_ns();
+	for (k = 0; k < BENCH_LOOPS; k++) {
+		for (i = 0; i < BENCH_FRAME_SIZE; i++) {
+			l_pcm = (packed[0][i] >> 16) + (packed[1][i] >> 16) +
+					(packed[2][i] >> 16) + (packed[3][i] >> 16);
+			r_pcm = (packed[0][i] & 0xffff) + (packed[1][i] & 0xffff) +
+					(packed[2][i] & 0xffff) + (packed[3][i] & 0xffff);
+			frames[i] = (l_pcm >> 2) << 16 | (r_pcm >> 2);
+		}
+		sink += frames[k % BENCH_FRAME_SIZE];
+	}
+	t1 = now_ns();
+	report("packed sum (before)", t1 - t0, (long)BENCH_LOOPS * BENCH_FRAME_SIZE);
+
+	t0 = now_ns();
+	for (k = 0; k < BENCH_LOOPS; k++) {
+		mixer_mix(mix, BENCH_CH_NUM, frames, BENCH_FRAME_SIZE);
+		sink += frames[k % BENCH_FRAME_SIZE];
+	}
+	t1 = now_ns();
+	report("mixer_mix", t1 - t0, (long)BENCH_LOOPS * BENCH_FRAME_SIZE);
+
+	// both sides are summed when any channel is off centre
+	for (j = 0; j < BENCH_CH_NUM; j++)
+		mix[j].pan = (j & 1)? MIXER_PAN_RIGHT / 2: MIXER_PAN_LEFT / 2;
+	t0 = now_ns();
+	for (k = 0; k < BENCH_LOOPS; k++) {
+		mixer_mix(mix, BENCH_CH_NUM, frames, BENCH_FRAME_SIZE);
+		sink += frames[k % BENCH_FRAME_SIZE];
+	}
+	t1 = now_ns();
+	report("mixer_mix (panned)", t1 - t0, (long)BENCH_LOOPS * BENCH_FRAME_SIZE);
+}
+
+/******************************************************
+ * sample rate conversion to 48kHz
+ ******************************************************/
+
+static void bench_resample_mode(u32 rate, int mode)
+{
+	static short in[RESAMPLE_CHUNK];
+	static short res[RESAMPLE_CHUNK * 4];
+	Resampler rs;
+	char name[32];
+	double t0, t1;
+	long total = 0;
+	int i, k;
+
+	for (i = 0; i < RESAMPLE_CHUNK; i++)
+		in[i] = (short)(sin(2 * M_PI * 1000 * i / rate) * 16000);
+	resampler_init(&rs, rate, 48000, mode);
+
+	// BENCH_LOOPS / 10 seconds of source audio
+	t0 = now_ns();
+	for (k = 0; k < BENCH_LOOPS / 10; k++) {
+		for (i = 0; i < (int)rate; i += RESAMPLE_CHUNK)
+			total += resampler_process(&rs, in, RESAMPLE_CHUNK, res, RESAMPLE_CHUNK * 4);
+		sink += res[k % RESAMPLE_CHUNK];
+	}
+	t1 = now_ns();
+	sprintf(name, "%s %u->48000", (mode == RESAMPLE_SINC)? "sinc": "linear", rate);
+	printf("  %-28s %8.2f ns/sample %8.3f ms/sec of audio\n", name,
+		(t1 - t0) / total, (t1 - t0) / 1e6 / (BENCH_LOOPS / 10));
+}
+
+static void bench_resample(void)
+{
+	printf("Resampler (%d taps, %d phases)\n", RESAMPLE_TAPS, RESAMPLE_PHASES);
+	bench_resample_mode(44100, RESAMPLE_LINEAR);
+	bench_resample_mode(44100, RESAMPLE_SINC);
+	bench_resample_mode(22050, RESAMPLE_LINEAR);
+	bench_resample_mode(22050, RESAMPLE_SINC);
+}
+
+/******************************************************
+ * sample format conversion to 16bit
+ ******************************************************/
+
+#define CONV_SAMPLES		4096
+
+static void bench_convert(void)
+{
+	static u8 raw[CONV_SAMPLES * 4];
+	static short res[CONV_SAMPLES * 2];
+	float *f = (float *)raw;
+	double t0;
+	int i, k, fmt;
+	static const char *name[] = {
+		"u8", "s24", "s32", "f32", "mono->stereo", "stereo->mono", "deinterleave"
+	};
+
+	printf("Format converters (%d samples x %d loops)\n", CONV_SAMPLES, BENCH_LOOPS);
+	for (fmt = 0; fmt < 7; fmt++) {
+		for (i = 0; i < (int)sizeof(raw); i++)
+			raw[i] = (u8)rand();
+		if (fmt == 3) {
+			for (i = 0; i < CONV_SAMPLES; i++)
+				f[i] = (float)(rand() % 2400 - 1200) / 1000;
+		}
+
+		t0 = now_ns();
+		for (k = 0; k < BENCH_LOOPS; k++) {
+			switch (fmt) {
+			case 0: pcm_u8_to_s16(raw, res, CONV_SAMPLES); break;
+			case 1: pcm_s24_to_s16(raw, res, CONV_SAMPLES); break;
+			case 2: pcm_s32_to_s16((const int32_t *)raw, res, CONV_SAMPLES); break;
+			case 3: pcm_f32_to_s16(f, res, CONV_SAMPLES); break;
+			case 4: pcm_mono_to_stereo((const short *)raw, res, CONV_SAMPLES); break;
+			case 5: pcm_stereo_to_mono((const short *)raw, res, CONV_SAMPLES); break;
+			case 6: pcm_deinterleave((const short *)raw, 2, res, &res[CONV_SAMPLES], CONV_SAMPLES); break;
+			}
+			sink += res[k % CONV_SAMPLES];
+		}
+		report(name[fmt], now_ns() - t0, (long)BENCH_LOOPS * CONV_SAMPLES);
+	}
+}
+
+/******************************************************
+ * IMA-ADPCM block decode
+ ******************************************************/
+
+#define ADPCM_BLOCK_BYTES	1024		// mono, 2041 samples per block
+#define ADPCM_BLOCKS		64
+
+static const int ima_step[89] = {
+	7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+	50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230,
+	253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963,
+	1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327,
+	3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487,
+	12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+
+// reference encoder for the test data, mono
+static void ima_encode_block(const short *in, u8 *block)
+{
+	static const int index_adj[8] = { -1, -1, -1, -1, 2, 4, 6, 8 };
+	int pred = in[0], index = 0;
+	int i, code, diff, step, delta;
+
+	block[0] = pred & 0xff;
+	block[1] = (pred >> 8) & 0xff;
+	block[2] = index;
+	block[3] = 0;
+	memset(&block[4], 0, ADPCM_BLOCK_BYTES - 4);
+	for (i = 1; i < IMA_BLOCK_FRAMES(ADPCM_BLOCK_BYTES, 1); i++) {
+		step = ima_step[index];
+		diff = in[i] - pred;
+		code = (diff < 0)? 8: 0;
+		if (diff < 0) diff = -diff;
+		delta = step >> 3;
+		if (diff >= step) { code |= 4; diff -= step; delta += step; }
+		if (diff >= step >> 1) { code |= 2; diff -= step >> 1; delta += step >> 1; }
+		if (diff >= step >> 2) { code |= 1; delta += step >> 2; }
+		pred += (code & 8)? -delta: delta;
+		if (pred > 32767) pred = 32767;
+		if (pred < -32768) pred = -32768;
+		index += index_adj[code & 7];
+		if (index < 0) index = 0;
+		if (index > 88) index = 88;
+		block[4 + (i - 1) / 2] |= (i & 1)? code: code << 4;
+	}
+}
+
+static void bench_adpcm(void)
+{
+	static u8 blocks[ADPCM_BLOCKS][ADPCM_BLOCK_BYTES];
+	static short pcm[IMA_BLOCK_FRAMES(ADPCM_BLOCK_BYTES, 1)];
+	int frames = IMA_BLOCK_FRAMES(ADPCM_BLOCK_BYTES, 1);
+	double t0, err = 0;
+	long total = 0;
+	int i, k;
+
+	for (k = 0; k < ADPCM_BLOCKS; k++) {
+		for (i = 0; i < frames; i++)
+			pcm[i] = (short)(sin(2 * M_PI * 440 * (k * frames + i) / 48000) * 12000);
+		ima_encode_block(pcm, blocks[k]);
+	}
+	ima_decode_channel(blocks[0], ADPCM_BLOCK_BYTES, 1, 0, pcm, 1);
+	for (i = 0; i < frames; i++)
+		err += pow(pcm[i] - sin(2 * M_PI * 440 * i / 48000) * 12000, 2);
+
+	printf("IMA-ADPCM decode (%d bytes blocks, rms error %.1f)\n",
+		ADPCM_BLOCK_BYTES, sqrt(err / frames));
+	t0 = now_ns();
+	for (k = 0; k < BENCH_LOOPS; k++) {
+		total += ima_decode_channel(blocks[k % ADPCM_BLOCKS], ADPCM_BLOCK_BYTES, 1, 0, pcm, 1);
+		sink += pcm[k % frames];
+	}
+	report("ima_decode_channel", now_ns() - t0, total);
+}
+
+/******************************************************
+ * Q15 effects chain
+ ******************************************************/
+
+#define FX_FRAMES			4800		// 100 msec
+
+static void bench_fx(void)
+{
+	static u32 frames[FX_FRAMES];
+	FxChain fx;
+	double t0;
+	int i, k, stage;
+	static const char *name[] = {
+		"bypass", "high-pass 100Hz", "low-pass 4kHz", "echo 250ms", "reverb", "all stages"
+	};
+
+	printf("Effects chain (%d frames x %d loops)\n", FX_FRAMES, BENCH_LOOPS / 10);
+	for (stage = 0; stage < 6; stage++) {
+		fx_init(&fx);
+		if (stage == 1 || stage == 5) fx_set_hpf(&fx, 100);
+		if (stage == 2 || stage == 5) fx_set_lpf(&fx, 4000);
+		if (stage == 3 || stage == 5) fx_set_echo(&fx, 250, 40, 50);
+		if (stage == 4 || stage == 5) fx_set_reverb(&fx, 50, 30);
+
+		for (i = 0; i < FX_FRAMES; i++)
+			frames[i] = (u32)rand();
+		t0 = now_ns();
+		for (k = 0; k < BENCH_LOOPS / 10; k++) {
+			fx_process(&fx, frames, FX_FRAMES);
+			sink += frames[k % FX_FRAMES];
+		}
+		report(name[stage], now_ns() - t0, (long)BENCH_LOOPS / 10 * FX_FRAMES);
+		fx_free(&fx);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	bench_psg();
+	bench_mixer();
+	bench_resample();
+	bench_convert();
+	bench_adpcm();
+	bench_fx();
+	return 0;
+}
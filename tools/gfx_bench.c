@@ -0,0 +1,310 @@
+/******************************************************
+ *    Filename:     gfx_bench.c
+ *     Purpose:     demo frames on the software gfxaccel
+ *  Target Plf:     Linux host / ZYBO (azplf)
+ *  Created on: 	2026/10/17
+ * Modified on:
+ *      Author: 	atsupi.com
+ *     Version:		0.90
+ ******************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "azplf_bsp.h"
+#include "gfxaccel.h"
+
+#define BENCH_BASE			0x11000000		// WRITE_ADDRESS_BASE
+#define BENCH_PAGE			(DISP_WIDTH * DISP_HEIGHT * 4)
+#define BENCH_FB(n)			(BENCH_BASE + (n) * BENCH_PAGE)
+#define BENCH_RES			BENCH_FB(2)
+#define BENCH_CACHE			BENCH_FB(3)		// background for the partial redraw
+#define BENCH_FRAMES		300
+
+static GfxaccelInstance gfx;
+static GfxaccelList background;
+static DamageRegion damage[2];
+static u32 *ref_mem;
+static int ref_mode = 0;			// draw with the plain C reference
+
+static double now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ts.tv_sec * 1e9 + ts.tv_nsec);
+}
+
+// FNV-1a over the pixels as stored in memory
+static u32 fnv1a(const u32 *pixels, int num)
+{
+	const u8 *p = (const u8 *)pixels;
+	u32 hash = 2166136261u;
+	long i;
+
+	for (i = 0; i < (long)num * sizeof(u32); i++) {
+		hash ^= p[i];
+		hash *= 16777619u;
+	}
+	return (hash);
+}
+
+/******************************************************
+ * reference: one pixel at a time, as the IP is specified
+ ******************************************************/
+
+static u32 *ref_fb(u32 fb)
+{
+	return (ref_mem + (fb - BENCH_BASE) / 4);
+}
+
+static void ref_fill(u32 fb, int x1, int y1, int x2, int y2, u32 col)
+{
+	int x, y;
+
+	for (y = y1; y <= y2 && y < DISP_HEIGHT; y++)
+		for (x = x1; x <= x2 && x < DISP_WIDTH; x++)
+			ref_fb(fb)[y * DISP_WIDTH + x] = col;
+}
+
+static void ref_line(u32 fb, int x1, int y1, int x2, int y2, u32 col)
+{
+	int dx = abs(x2 - x1), dy = -abs(y2 - y1);
+	int sx = (x2 > x1)? 1: -1, sy = (y2 > y1)? 1: -1;
+	int err = dx + dy, e2;
+
+	while (1) {
+		ref_fb(fb)[y1 * DISP_WIDTH + x1] = col;
+		if (x1 == x2 && y1 == y2) break;
+		e2 = 2 * err;
+		if (e2 >= dy) { err += dy; x1 += sx; }
+		if (e2 <= dx) { err += dx; y1 += sy; }
+	}
+}
+
+static void ref_blit(u32 src, int x1, int y1, int dx, int dy, u32 dst, int x2, int y2, int op)
+{
+	u32 *s, *d;
+	int x, y;
+
+	for (y = 0; y < dy; y++) {
+		for (x = 0; x < dx; x++) {
+			s = &ref_fb(src)[(y1 + y) * DISP_WIDTH + x1 + x];
+			d = &ref_fb(dst)[(y2 + y) * DISP_WIDTH + x2 + x];
+			if (op == GFXACCEL_BB_OR)       *d |= *s;
+			else if (op == GFXACCEL_BB_AND) *d &= *s;
+			else if (op == GFXACCEL_BB_XOR) *d ^= *s;
+			else                            *d  = *s;
+		}
+	}
+}
+
+static void fill(u32 fb, int x1, int y1, int x2, int y2, u32 col)
+{
+	if (ref_mode) ref_fill(fb, x1, y1, x2, y2, col);
+	else gfxaccel_submit_fill_rect(&gfx, fb, x1, y1, x2, y2, col);
+}
+
+static void line(u32 fb, int x1, int y1, int x2, int y2, u32 col)
+{
+	if (ref_mode) ref_line(fb, x1, y1, x2, y2, col);
+	else gfxaccel_submit_draw_line(&gfx, fb, x1, y1, x2, y2, col);
+}
+
+static void blit(u32 src, int x1, int y1, int dx, int dy, u32 dst, int x2, int y2, int op)
+{
+	if (ref_mode) ref_blit(src, x1, y1, dx, dy, dst, x2, y2, op);
+	else gfxaccel_submit_bitblt(&gfx, src, x1, y1, dx, dy, dst, x2, y2, op);
+}
+
+/******************************************************
+ * frames of the demo scenes
+ ******************************************************/
+
+// colour tiles as fillColorTiles() makes them in the demo
+static void setup_resource(void)
+{
+	int i, j, col;
+
+	for (i = 0; i < DISP_HEIGHT / 16; i++) {
+		for (j = 0; j < DISP_WIDTH / 16; j++) {
+			col = (i << 2) | j;
+			fill(BENCH_RES, j * 16, i * 16, j * 16 + 15, i * 16 + 15,
+				RGB1(col >> 2, col >> 1, col) ^ RGB10(i * 33, j * 20, i * j));
+		}
+	}
+}
+
+// header, 15x15 map tiles and the side fills of scene 1
+static void draw_background(u32 fb)
+{
+	int i;
+
+	blit(BENCH_RES, 0, 0, 800, 128, fb, 0, 0, GFXACCEL_BB_NONE);
+	for (i = 0; i < 225; i++)
+		blit(BENCH_RES, (i * 7 % 8) * 32, (i % 4) * 32, 32, 32, fb, (i % 15) * 32 + 160, (i / 15) * 32, GFXACCEL_BB_NONE);
+	fill(fb, 0, 128, 159, 479, 0);
+	fill(fb, 640, 128, 799, 479, 0);
+}
+
+static void draw_frame(u32 fb, int n)
+{
+	int i, x = n % 24, y = n / 24 % 14;
+
+	// counter text, the square, masked sprite and the triangles of scene 0
+	for (i = 0; i < 11; i++)
+		blit(BENCH_RES, 256 + (n + i) % 16 * 16, 16 + i % 3 * 16, 16, 16, fb, 606 + i * 16, 448, GFXACCEL_BB_NONE);
+	fill(fb, x * 32, y * 32, x * 32 + 63, y * 32 + 63, RGB8(255, 255, 255));
+	blit(BENCH_RES, 544, 32, 32, 32, fb, 448, n * 2 % 448, GFXACCEL_BB_AND);
+	blit(BENCH_RES, 512, 32, 32, 32, fb, 448, n * 2 % 448, GFXACCEL_BB_OR);
+	blit(BENCH_RES, 576, 64, 32, 32, fb, 300, 300, GFXACCEL_BB_XOR);
+	for (i = 0; i < 12; i++) {
+		line(fb, 310 + i * 15, 350 - i * 20, 340 + i * 15, 300 - i * 20, 0xffffffff);
+		line(fb, 370 + i * 15, 350 - i * 20, 310 + i * 15, 350 - i * 20, 0x3ff00000);
+	}
+}
+
+static void render(int frames, int use_list)
+{
+	int n;
+
+	for (n = 0; n < frames; n++) {
+		if (use_list && !ref_mode)
+			gfxaccel_list_replay(&gfx, &background);
+		else
+			draw_background(BENCH_FB(n & 1));
+		draw_frame(BENCH_FB(n & 1), n);
+	}
+	if (!ref_mode) gfxaccel_finish(&gfx);
+}
+
+// the background is copied back only where the frame before last drew
+static void render_partial(int frames)
+{
+	DamageRegion *dmg;
+	DamageRect *r;
+	int n, i;
+
+	draw_background(BENCH_CACHE);
+	for (i = 0; i < 2; i++) {
+		damage_init(&damage[i], BENCH_FB(i));
+		damage_add_all(&damage[i]);
+	}
+	for (n = 0; n < frames; n++) {
+		dmg = &damage[n & 1];
+		for (i = 0; i < dmg->num; i++) {
+			r = &dmg->rects[i];
+			blit(BENCH_CACHE, r->x1, r->y1, r->x2 - r->x1 + 1, r->y2 - r->y1 + 1,
+				dmg->fb, r->x1, r->y1, GFXACCEL_BB_NONE);
+		}
+		damage_clear(dmg);
+		gfxaccel_track_damage(&gfx, dmg);
+		draw_frame(dmg->fb, n);
+		gfxaccel_track_damage(&gfx, NULL);
+	}
+	gfxaccel_finish(&gfx);
+}
+
+// the 10bit frame buffer as an 8bit PPM image
+static void write_ppm(char *fn, const u32 *fb)
+{
+	FILE *fp = fopen(fn, "wb");
+	int i;
+
+	if (!fp) {
+		printf("Error: %s cannot be opened.\n", fn);
+		return;
+	}
+	fprintf(fp, "P6\n%d %d\n255\n", DISP_WIDTH, DISP_HEIGHT);
+	for (i = 0; i < DISP_WIDTH * DISP_HEIGHT; i++) {
+		fputc(fb[i] >> 22 & 0xff, fp);
+		fputc(fb[i] >> 12 & 0xff, fp);
+		fputc(fb[i] >> 2 & 0xff, fp);
+	}
+	fclose(fp);
+}
+
+static void usage(char *name)
+{
+	printf("Usage: %s [-q] [-o frame.ppm]\n", name);
+	printf("  -q  run the frames through the command queue\n");
+	printf("  -o  write the last frame as a PPM image\n");
+}
+
+int main(int argc, char *argv[])
+{
+	GfxaccelStats st, st_direct, st_partial;
+	char *out = 0;
+	double t0, t_direct, t_partial, t_list;
+	int c, queue = 0, diff, i;
+	u32 *fb;
+
+	while ((c = getopt(argc, argv, "qo:h")) != -1) {
+		switch (c) {
+		case 'q': queue = 1; break;
+		case 'o': out = optarg; break;
+		default: usage(argv[0]); return 1;
+		}
+	}
+
+	if (gfxaccel_init_soft(&gfx, BENCH_BASE, 4 * BENCH_PAGE) != PST_SUCCESS)
+		return 1;
+	ref_mem = (u32 *)calloc(3 * BENCH_PAGE / 4, 4);
+	if (!ref_mem) return 1;
+
+	setup_resource();
+	if (queue) gfxaccel_start_queue(&gfx);
+
+	gfxaccel_finish(&gfx);
+	gfxaccel_get_stats(&gfx, &st);
+	t0 = now_ns();
+	render(BENCH_FRAMES, 0);
+	t_direct = now_ns() - t0;
+	gfxaccel_get_stats(&gfx, &st_direct);
+
+	// ends with the same frame buffers as the direct frames
+	t0 = now_ns();
+	render_partial(BENCH_FRAMES);
+	t_partial = now_ns() - t0;
+	gfxaccel_get_stats(&gfx, &st_partial);
+
+	gfxaccel_list_begin(&gfx, &background);
+	draw_background(BENCH_FB(0));
+	gfxaccel_list_end(&gfx);
+	t0 = now_ns();
+	render(1, 1);	// the list only draws frame buffer 0
+	t_list = now_ns() - t0;
+
+	// the same frames drawn by the reference
+	ref_mode = 1;
+	setup_resource();
+	render(BENCH_FRAMES, 0);
+	render(1, 0);
+
+	fb = gfxaccel_get_fb(&gfx, BENCH_FB(0));
+	for (diff = i = 0; i < 2 * BENCH_PAGE / 4; i++)
+		if (fb[i] != ref_mem[i]) diff++;
+
+	printf("%d frames %dx%d (%s)\n", BENCH_FRAMES, DISP_WIDTH, DISP_HEIGHT, queue? "queued": "direct");
+	printf("  frame     : %8.1f us (%u cmds, %llu pixels)\n", t_direct / BENCH_FRAMES / 1000,
+		(st_direct.cmds - st.cmds) / BENCH_FRAMES, (st_direct.pixels - st.pixels) / BENCH_FRAMES);
+	printf("  registers : %llu written, %llu elided per frame\n",
+		(st_direct.reg_writes - st.reg_writes) / BENCH_FRAMES,
+		(st_direct.reg_elided - st.reg_elided) / BENCH_FRAMES);
+	printf("  partial   : %8.1f us (%u cmds, %llu pixels)\n", t_partial / BENCH_FRAMES / 1000,
+		(st_partial.cmds - st_direct.cmds) / BENCH_FRAMES,
+		(st_partial.pixels - st_direct.pixels) / BENCH_FRAMES);
+	printf("  registers : %llu written, %llu elided per frame\n",
+		(st_partial.reg_writes - st_direct.reg_writes) / BENCH_FRAMES,
+		(st_partial.reg_elided - st_direct.reg_elided) / BENCH_FRAMES);
+	printf("  list frame: %8.1f us\n", t_list / 1000);
+	printf("  fnv1a     : %08x\n", fnv1a(fb, DISP_WIDTH * DISP_HEIGHT));
+	printf("  reference : %s (%d pixels differ)\n", diff? "MISMATCH": "match", diff);
+
+	if (out) write_ppm(out, fb);
+	gfxaccel_list_free(&gfx, &background);
+	gfxaccel_deinit(&gfx);
+	free(ref_mem);
+	return (diff? 1: 0);
+}
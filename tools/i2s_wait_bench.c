@@ -0,0 +1,87 @@
+/******************************************************
+ *    Filename:     i2s_wait_bench.c
+ *     Purpose:     CPU cost of feeding the I2S FIFO
+ *  Target Plf:     Linux host (emulated I2S FIFO)
+ *  Created on: 	2026/10/17
+ * Modified on:
+ *      Author: 	atsupi.com
+ *     Version:		0.90
+ ******************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include "azplf_bsp.h"
+#include "azplf_audio.h"
+
+#define BENCH_SECONDS		2
+#define BENCH_FRAMES		(48000 * BENCH_SECONDS)
+
+static u32 frames[AUDIO_BLOCK_SIZE];
+
+static double now_sec(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ts.tv_sec + ts.tv_nsec / 1e9);
+}
+
+static double cpu_sec(void)
+{
+	struct rusage ru;
+	getrusage(RUSAGE_SELF, &ru);
+	return (ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6 +
+			ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6);
+}
+
+static void report(const char *name, double wall, double cpu)
+{
+	printf("  %-24s wall %6.3f sec, cpu %6.3f sec (%5.1f%%)\n",
+		name, wall, cpu, cpu * 100 / wall);
+}
+
+// spin on the status register before every frame, as before
+static void bench_spin(void)
+{
+	double w0 = now_sec(), c0 = cpu_sec();
+	int i;
+
+	i2sout_init();
+	for (i = 0; i < BENCH_FRAMES; i++) {
+		while ((i2sout_getstatus(0x0C) & 0xC));
+		i2sout_senddata(4, 0);
+	}
+	report("spin on status", now_sec() - w0, cpu_sec() - c0);
+}
+
+static void bench_write(int thread)
+{
+	double w0, c0;
+	int i;
+
+	i2sout_init();
+	azplf_audio_reset_stats();
+	if (thread) azplf_audio_start_thread();
+	w0 = now_sec();
+	c0 = cpu_sec();
+	for (i = 0; i < BENCH_FRAMES; i += AUDIO_BLOCK_SIZE)
+		azplf_audio_write(frames, AUDIO_BLOCK_SIZE);
+	if (thread) {
+		while (azplf_audio_get_fill())
+			usleep(AUDIO_POLL_US);
+		azplf_audio_stop_thread();
+	}
+	report(thread? "audio thread": "azplf_audio_write", now_sec() - w0, cpu_sec() - c0);
+	azplf_audio_dump_stats();
+}
+
+int main(int argc, char *argv[])
+{
+	printf("%d sec of frames through a %d frames FIFO\n", BENCH_SECONDS, I2SOUT_FIFO_DEPTH);
+	bench_spin();
+	bench_write(0);
+	bench_write(1);
+	return 0;
+}
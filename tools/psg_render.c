@@ -0,0 +1,132 @@
+/******************************************************
+ *    Filename:     psg_render.c
+ *     Purpose:     offline render of PSG/MML music
+ *  Target Plf:     Linux host / ZYBO (azplf)
+ *  Created on: 	2026/10/17
+ * Modified on:
+ *      Author: 	atsupi.com
+ *     Version:		0.90
+ ******************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include "azplf_bsp.h"
+#include "psg_util.h"
+#include "psg_osc.h"
+#include "wav_util.h"
+
+#define DEF_SECONDS			60
+#define DEF_VOLUME			10
+
+static int volume = DEF_VOLUME;
+
+// psg_util.c is linked without the audio HAL: volume comes from the
+// command line and nothing is written to the I2S FIFO
+int azplf_audio_get_volume(void)
+{
+	return (volume);
+}
+
+int azplf_audio_write(const u32 *frames, int n)
+{
+	return (n);
+}
+
+int azplf_audio_get_request(void)
+{
+	return (PSG_FRAME_SIZE);
+}
+
+void azplf_audio_process_fx(int bus, u32 *frames, int n)
+{
+}
+
+static double now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ts.tv_sec * 1e9 + ts.tv_nsec);
+}
+
+// FNV-1a over the frames as stored in memory
+static u32 fnv1a(const u32 *frames, int num)
+{
+	const u8 *p = (const u8 *)frames;
+	u32 hash = 2166136261u;
+	long i;
+
+	for (i = 0; i < (long)num * sizeof(u32); i++) {
+		hash ^= p[i];
+		hash *= 16777619u;
+	}
+	return (hash);
+}
+
+static void usage(char *name)
+{
+	printf("Usage: %s [-s seconds] [-l] [-v volume] [-c kbytes] [-o out.wav] [mml_file]\n", name);
+	printf("  -s  maximum length in seconds (default %d)\n", DEF_SECONDS);
+	printf("  -l  stop when the song loops\n");
+	printf("  -v  volume 0~15 (default %d)\n", DEF_VOLUME);
+	printf("  -c  loop render cache budget, 0 to disable (default %d)\n", PSG_CACHE_BUDGET / 1024);
+	printf("      cached loops are close to, not bit-exact with, live synthesis\n");
+	printf("  -o  write 16bit stereo WAV file\n");
+}
+
+int main(int argc, char *argv[])
+{
+	char *out_fn = NULL;
+	int seconds = DEF_SECONDS;
+	int until_loop = 0;
+	int max_frames, num;
+	u32 *frames;
+	double t0, t1, sec;
+	PsgStats stats;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "s:lv:c:o:h")) != -1) {
+		switch (opt) {
+		case 's': seconds = atoi(optarg); break;
+		case 'l': until_loop = 1; break;
+		case 'v': volume = atoi(optarg) & 0xF; break;
+		case 'c': PsgSetRenderCache((size_t)atoi(optarg) * 1024); break;
+		case 'o': out_fn = optarg; break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if (optind < argc && LoadMMLData(argv[optind]) != PST_SUCCESS)
+		return 1;
+
+	max_frames = seconds * PSG_SAMPLE_RATE;
+	frames = (u32 *)malloc(max_frames * sizeof(u32));
+	if (!frames) {
+		printf("Error: Cannot allocate %d frames.\n", max_frames);
+		return 1;
+	}
+
+	t0 = now_ns();
+	num = PsgRenderMusic(frames, max_frames, until_loop);
+	t1 = now_ns();
+	sec = (t1 - t0) / 1e9;
+
+	printf("frames    : %d (%.2f sec%s)\n", num, (double)num / PSG_SAMPLE_RATE,
+		(until_loop && PsgGetLoopCount())? ", looped": "");
+	printf("time      : %.3f msec\n", sec * 1e3);
+	printf("throughput: %.0f samples/sec, %.1fx realtime\n",
+		num / sec, num / sec / PSG_SAMPLE_RATE);
+	PsgGetStats(&stats);
+	printf("cached    : %u track slices in %u slices\n", stats.cached, stats.slices);
+	printf("fnv1a     : %08x\n", fnv1a(frames, num));
+
+	if (out_fn && wav_writefile(out_fn, frames, num, PSG_SAMPLE_RATE) != PST_SUCCESS) {
+		free(frames);
+		return 1;
+	}
+	free(frames);
+	return 0;
+}